@@ -40,6 +40,14 @@ Release under the GNU General Public License v3
 
 QMC5883LCompass compass;
 
+void calibrationCallback(float progress, bool foundNewValue) {
+  if ( foundNewValue ) {
+    Serial.print("Coverage: ");
+    Serial.print(compass.getCalibrationCoverage());
+    Serial.println("%");
+  }
+}
+
 void setup() {
   Serial.begin(9600);
   compass.init();
@@ -49,7 +57,8 @@ void setup() {
   delay(5000);
 
   Serial.println("CALIBRATING. Keep moving your sensor...");
-  compass.calibrate();
+  compass.setCalibrationTargets(90, 80);
+  compass.calibrate(60, calibrationCallback);
 
   Serial.println("DONE. Copy the lines below and paste it into your projects sketch.);");
   Serial.println();
@@ -0,0 +1,32 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Footprint Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example prints how much RAM each QMC5883LCompass instance uses on your board. Use it to plan
+projects that run several sensors on a board with little memory.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+
+QMC5883LCompass compass;
+
+void setup() {
+  Serial.begin(9600);
+
+  Serial.print("sizeof(QMC5883LCompass): ");
+  Serial.print(sizeof(QMC5883LCompass));
+  Serial.println(" bytes");
+
+  Serial.print("4 sensors: ");
+  Serial.print(4 * sizeof(QMC5883LCompass));
+  Serial.println(" bytes");
+}
+
+void loop() {
+  delay(1000);
+}
@@ -0,0 +1,72 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Fusion Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example shows how to combine the compass with a gyroscope and an accelerometer for a heading that
+follows turns quickly and stays stable. Replace readGyro() and readAccel() with the code for your IMU.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LFusion.h>
+
+QMC5883LCompass compass;
+QMC5883LFusion fusion;
+
+unsigned long lastUpdate;
+unsigned long lastCompassRead;
+
+// Angular rate in radians per second.
+void readGyro(float *g) {
+  g[0] = 0;
+  g[1] = 0;
+  g[2] = 0;
+}
+
+// Acceleration in any unit, Z positive when lying flat.
+void readAccel(float *a) {
+  a[0] = 0;
+  a[1] = 0;
+  a[2] = 1;
+}
+
+void setup() {
+  Serial.begin(9600);
+  compass.init();
+  lastUpdate = micros();
+  lastCompassRead = millis();
+}
+
+void loop() {
+  float g[3];
+  float a[3];
+  readGyro(g);
+  readAccel(a);
+
+  unsigned long now = micros();
+  float dt = (now - lastUpdate) / 1000000.0;
+  lastUpdate = now;
+
+  // The gyro runs faster than the compass, only use the compass when it has a new reading.
+  if ( millis() - lastCompassRead >= 20 ) {
+    lastCompassRead = millis();
+    compass.read();
+    fusion.update(compass, g[0], g[1], g[2], a[0], a[1], a[2], dt);
+  } else {
+    fusion.updateIMU(g[0], g[1], g[2], a[0], a[1], a[2], dt);
+  }
+
+  Serial.print("Heading: ");
+  Serial.print(fusion.getHeading());
+  Serial.print(" Pitch: ");
+  Serial.print(fusion.getPitch());
+  Serial.print(" Roll: ");
+  Serial.print(fusion.getRoll());
+  Serial.println();
+
+  delay(5);
+}
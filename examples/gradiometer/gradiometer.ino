@@ -0,0 +1,54 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Gradiometer Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example uses two compasses, one on each I2C bus, mounted 50 cm apart with the same orientation
+as a gradiometer. It prints how strongly a nearby iron object or magnet stands out from the earth's field.
+Send 'c' over serial to cross calibrate for 30 seconds, turning the pair slowly in all directions.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LGradiometer.h>
+
+QMC5883LCompass first;
+QMC5883LCompass second;
+QMC5883LGradiometer gradiometer;
+
+unsigned long calibrationEnd = 0;
+
+void setup() {
+  Serial.begin(115200);
+  first.init(&Wire);
+  second.init(&Wire1);
+  gradiometer.init(&first, &second);
+  gradiometer.setBaseline(0.5);
+}
+
+void loop() {
+  if ( Serial.read() == 'c' ) {
+    Serial.println("Cross calibrating, turn the sensors slowly in all directions...");
+    gradiometer.startCrossCalibration();
+    calibrationEnd = millis() + 30000;
+  }
+
+  if ( calibrationEnd != 0 && (long)(millis() - calibrationEnd) >= 0 ) {
+    calibrationEnd = 0;
+    Serial.println(gradiometer.finishCrossCalibration() ? "Done." : "Failed, turn the sensors more.");
+  }
+
+  if ( gradiometer.update() && calibrationEnd == 0 ) {
+    Serial.print("Gradient: ");
+    Serial.print(gradiometer.getX());
+    Serial.print(" ");
+    Serial.print(gradiometer.getY());
+    Serial.print(" ");
+    Serial.print(gradiometer.getZ());
+    Serial.print(" Strength: ");
+    Serial.println(gradiometer.getStrength());
+  }
+}
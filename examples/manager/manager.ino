@@ -0,0 +1,41 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Manager Example Sketch
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+This example reads two compasses, one on each I2C bus of the board, and prints their headings as
+time aligned sets. Boards with more buses (ESP32, Teensy, RP2040) can add more sensors the same way.
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LManager.h>
+
+QMC5883LManager<2> sensors;
+
+void setup() {
+  Serial.begin(115200);
+
+  sensors.attach(&Wire);
+  sensors.attach(&Wire1);
+  sensors.init();
+  sensors.setInterval(20000); // 50 sets per second
+}
+
+void loop() {
+  if ( sensors.update() ) {
+    Serial.print(sensors.getTimestamp());
+    for ( byte i = 0; i < sensors.getCount(); i++ ) {
+      Serial.print(" X: ");
+      Serial.print(sensors.getX(i));
+      Serial.print(" Y: ");
+      Serial.print(sensors.getY(i));
+      Serial.print(" Z: ");
+      Serial.print(sensors.getZ(i));
+    }
+    Serial.println();
+  }
+}
@@ -0,0 +1,134 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Azimuth Accuracy Test
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Checks the integer atan2 behind getAzimuthCentidegrees() against atan2() in double precision
+for every pair of 16 bit X / Y values, through QMC5883LBatch::azimuth() with no declination,
+and reports the largest and mean error in degrees and where the largest one is. The
+documented bound is 0.012 degrees. It then times the integer azimuth against atan2f() on
+this machine.
+
+Built without -mavx2 or -msse4.1 the batch runs the same code as getAzimuthCentidegrees(),
+with them the SIMD version is checked. All 2^32 pairs take a few minutes on one core, and
+the pairs are split over all cores. Give a step to check every step-th value on both axes.
+Build it from the library folder together with all .cpp files in src, e.g. with g++:
+
+    g++ -O2 -pthread -Isrc extras/linux/atan_test.cpp src/QMC5883L*.cpp -o atan_test
+    ./atan_test [step] [threads]
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LBatch.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <thread>
+#include <vector>
+
+// Largest documented error, in hundredths of a degree.
+#define BOUND 1.2
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// What one thread finds for its rows, on its own cache lines.
+struct alignas(64) Part {
+  double worst;
+  double sum;
+  unsigned long count;
+  int worstX;
+  int worstY;
+};
+
+static QMC5883LCompass compass;
+static int step = 1;
+
+static void check(Part *part, long firstY, long endY) {
+  std::vector<int16_t> x, y;
+  for ( long v = INT16_MIN; v <= INT16_MAX; v += step ) x.push_back((int16_t)v);
+  y.resize(x.size());
+  std::vector<uint16_t> azimuth(x.size());
+
+  for ( long row = firstY; row < endY; row += step ) {
+    for ( int16_t &value : y ) value = (int16_t)row;
+    QMC5883LBatch::azimuth(&compass, x.data(), y.data(), azimuth.data(), x.size());
+    for ( size_t i = 0; i < x.size(); i++ ) {
+      if ( x[i] == 0 && row == 0 ) continue;
+      double exact = atan2((double)row, (double)x[i]) * 18000. / M_PI;
+      double error = fabs(azimuth[i] - exact);
+      if ( error > 18000. ) error = 36000. - error;
+      part->sum += error;
+      part->count++;
+      if ( error > part->worst ) {
+        part->worst = error;
+        part->worstX = x[i];
+        part->worstY = (int)row;
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  step = argc > 1 ? atoi(argv[1]) : 1;
+  if ( step < 1 ) step = 1;
+  unsigned int threads = argc > 2 ? atoi(argv[2]) : std::thread::hardware_concurrency();
+  if ( threads < 1 ) threads = 1;
+  printf("QMC5883LBatch built for %s, every %d. value, %u threads\n", QMC5883LBatch::getInstructionSet(), step, threads);
+
+  // Split the rows so every thread starts on a multiple of the step.
+  long rows = (65536 + step - 1) / step;
+  std::vector<Part> parts(threads);
+  std::vector<std::thread> pool;
+  double start = now();
+  for ( unsigned int t = 0; t < threads; t++ ) {
+    long first = INT16_MIN + rows * t / threads * step;
+    long end = INT16_MIN + rows * (t + 1) / threads * step;
+    pool.emplace_back(check, &parts[t], first, end);
+  }
+  for ( std::thread &thread : pool ) thread.join();
+
+  Part all = {};
+  for ( const Part &part : parts ) {
+    all.sum += part.sum;
+    all.count += part.count;
+    if ( part.worst > all.worst ) all = {part.worst, all.sum, all.count, part.worstX, part.worstY};
+  }
+  printf("%lu pairs in %.1f s: largest error %.4f degrees at (x %d, y %d), mean %.4f degrees\n", all.count, now() - start,
+    all.worst / 100., all.worstX, all.worstY, all.sum / all.count / 100.);
+
+  // Throughput on 4M random pairs, the integer azimuth against atan2f() in float.
+  const size_t n = 4000000;
+  std::vector<int16_t> x(n), y(n);
+  std::vector<uint16_t> azimuth(n);
+  uint32_t seed = 12345;
+  for ( size_t i = 0; i < n; i++ ) {
+    seed = seed * 1664525 + 1013904223;
+    x[i] = (int16_t)(seed >> 16);
+    y[i] = (int16_t)seed;
+  }
+  start = now();
+  QMC5883LBatch::azimuth(&compass, x.data(), y.data(), azimuth.data(), n);
+  double integer = now() - start;
+  long sum = 0;
+  start = now();
+  for ( size_t i = 0; i < n; i++ ) {
+    float heading = atan2f((float)y[i], (float)x[i]) * 18000.f / (float)M_PI;
+    azimuth[i] = (uint16_t)(heading < 0 ? heading + 36000.f : heading);
+    sum += azimuth[i];
+  }
+  double single = now() - start;
+  printf("ns per azimuth on this machine: integer %.2f, atan2f %.2f (%ld)\n", integer / n * 1e9, single / n * 1e9, sum % 10);
+
+  bool ok = all.worst <= BOUND;
+  printf("%s, bound %.3f degrees\n", ok ? "PASS" : "FAIL", BOUND / 100.);
+  return ok ? 0 : 1;
+}
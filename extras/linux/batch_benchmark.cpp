@@ -0,0 +1,156 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Batch Benchmark
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Checks QMC5883LBatch against the compass processing one sample at a time, on random samples,
+the edges of the 16 bit range and a grid over all X / Y directions, and measures both in
+samples per second. It fails when any sample comes out different. Build it from the library
+folder together with all .cpp files in src, once for each instruction set, e.g. with g++:
+
+    g++ -O2 -mavx2 -Isrc extras/linux/batch_benchmark.cpp src/QMC5883L*.cpp -o batch_benchmark
+    g++ -O2 -msse4.1 ...
+    g++ -O2 ...
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LBatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+static uint32_t seed = 12345;
+
+static int16_t random16() {
+  seed = seed * 1664525 + 1013904223;
+  return (int16_t)(seed >> 16);
+}
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+struct Samples {
+  std::vector<int16_t> x, y, z;
+
+  void add(int16_t vx, int16_t vy, int16_t vz) {
+    x.push_back(vx);
+    y.push_back(vy);
+    z.push_back(vz);
+  }
+};
+
+// Random samples, every combination of the edge values, and a grid over all directions.
+static Samples testSamples() {
+  Samples s;
+  for ( int i = 0; i < 2000000; i++ ) s.add(random16(), random16(), random16());
+  const int16_t edges[] = {-32768, -32767, -16384, -257, -256, -255, -1, 0, 1, 255, 256, 257, 16384, 32766, 32767};
+  for ( int16_t a : edges ) {
+    for ( int16_t b : edges ) {
+      for ( int16_t c : edges ) s.add(a, b, c);
+    }
+  }
+  for ( int a = -32768; a < 32768; a += 31 ) {
+    for ( int b = -32768; b < 32768; b += 29 ) s.add((int16_t)a, (int16_t)b, 0);
+  }
+  return s;
+}
+
+// Compare the batch against the compass, one sample at a time through its public functions.
+static unsigned long check(QMC5883LCompass &calibrated, QMC5883LCompass &plain, const Samples &s) {
+  size_t n = s.x.size();
+  std::vector<int16_t> cx(n), cy(n), cz(n);
+  std::vector<uint16_t> strength(n), azimuth(n);
+  QMC5883LBatch::calibrate(&calibrated, s.x.data(), s.y.data(), s.z.data(), cx.data(), cy.data(), cz.data(), n);
+  QMC5883LBatch::strength(s.x.data(), s.y.data(), s.z.data(), strength.data(), n);
+  QMC5883LBatch::azimuth(&plain, s.x.data(), s.y.data(), azimuth.data(), n);
+
+  unsigned long errors = 0;
+  for ( size_t i = 0; i < n; i++ ) {
+    QMC5883LRawSample raw = {0, s.x[i], s.y[i], s.z[i], INT16_MIN, 0};
+    calibrated.process(&raw);
+    plain.process(&raw);
+    bool ok = cx[i] == calibrated.getX() && cy[i] == calibrated.getY() && cz[i] == calibrated.getZ()
+           && strength[i] == plain.getFieldStrength() && azimuth[i] == plain.getAzimuthCentidegrees();
+    if ( !ok && errors++ < 5 ) {
+      printf("  mismatch at (%d, %d, %d): calibrated %d %d %d / %d %d %d, strength %u / %u, azimuth %u / %u\n",
+        s.x[i], s.y[i], s.z[i], cx[i], cy[i], cz[i], calibrated.getX(), calibrated.getY(), calibrated.getZ(),
+        strength[i], plain.getFieldStrength(), azimuth[i], plain.getAzimuthCentidegrees());
+    }
+  }
+  return errors;
+}
+
+int main() {
+  printf("QMC5883LBatch built for %s\n", QMC5883LBatch::getInstructionSet());
+
+  // The compass is only used for its math here, its bus is never opened.
+  QMC5883LCompass calibrated;
+  QMC5883LCompass plain;
+  Samples s = testSamples();
+
+  calibrated.setCalibrationOffsets(-312.4, 1045.75, 77.1);
+  calibrated.setCalibrationScales(1.137, 0.912, 1.004);
+  plain.setMagneticDeclination(-7, 25);
+  unsigned long mismatches = check(calibrated, plain, s);
+  unsigned long total = mismatches;
+  printf("typical calibration, declination: %lu mismatches in %zu samples\n", mismatches, s.x.size());
+
+  calibrated.setCalibrationOffsets(-4000000., 3999999.5, 0.25);
+  calibrated.setCalibrationScales(-1.5, 127.9, 0.0001);
+  plain.setMagneticDeclination(179, 59);
+  mismatches = check(calibrated, plain, s);
+  total += mismatches;
+  printf("extreme calibration, declination: %lu mismatches\n", mismatches);
+
+  plain.setMagneticDeclination(3, 10);
+  plain.setDeviation(1.5, -0.7, 2.2, 0.4, -0.3);
+  mismatches = check(calibrated, plain, s);
+  total += mismatches;
+  printf("deviation table: %lu mismatches\n", mismatches);
+  plain.clearDeviation();
+
+  // Throughput on 4M samples: the compass one sample at a time against the batch.
+  const size_t n = 4000000;
+  Samples b;
+  for ( size_t i = 0; i < n; i++ ) b.add(random16() / 4, random16() / 4, random16() / 4);
+  std::vector<int16_t> cx(n), cy(n), cz(n);
+  std::vector<uint16_t> strength(n), azimuth(n);
+  calibrated.setCalibrationOffsets(-312.4, 1045.75, 77.1);
+  calibrated.setCalibrationScales(1.137, 0.912, 1.004);
+
+  double start = now();
+  unsigned long sum = 0;
+  for ( size_t i = 0; i < n; i++ ) {
+    QMC5883LRawSample raw = {0, b.x[i], b.y[i], b.z[i], INT16_MIN, 0};
+    calibrated.process(&raw);
+    sum += calibrated.getFieldStrength() + calibrated.getAzimuthCentidegrees();
+  }
+  double single = now() - start;
+
+  double t[4];
+  start = now();
+  QMC5883LBatch::calibrate(&calibrated, b.x.data(), b.y.data(), b.z.data(), cx.data(), cy.data(), cz.data(), n);
+  t[0] = now() - start;
+  QMC5883LBatch::strength(cx.data(), cy.data(), cz.data(), strength.data(), n);
+  t[1] = now() - start - t[0];
+  QMC5883LBatch::azimuth(&calibrated, cx.data(), cy.data(), azimuth.data(), n);
+  t[2] = now() - start - t[0] - t[1];
+  t[3] = now() - start;
+  for ( size_t i = 0; i < n; i++ ) sum -= strength[i] + azimuth[i];
+
+  printf("one at a time (process, strength, azimuth) %7.1f M samples/s\n", n / single / 1e6);
+  printf("batch calibrate %7.1f, strength %7.1f, azimuth %7.1f, all three %7.1f M samples/s (%s)\n",
+    n / t[0] / 1e6, n / t[1] / 1e6, n / t[2] / 1e6, n / t[3] / 1e6, sum == 0 ? "same results" : "DIFFERENT RESULTS");
+
+  bool ok = total == 0 && sum == 0;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,476 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Log Calibration
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Finds the calibration of a compass from a long recording of raw readings, e.g. a whole day in a
+vehicle, on a PC. calibrate() on the chip takes the min / max of each axis, so a single spike
+spoils it. This tool fits an ellipsoid to all samples instead: Levenberg-Marquardt on the
+distance of every sample from the ellipsoid, then the samples that are far off (spikes,
+magnets nearby) are left out and the fit is repeated until the set of samples no longer changes.
+The ellipsoid is axis aligned, as the compass only has offsets and scales per axis, and the
+result is printed as the lines to paste into a sketch, like the calibration example does.
+
+An axis the log hardly moves along can not be fitted, e.g. Z in a vehicle that stays level:
+its samples lie on a circle, which fits infinitely many ellipsoids. When the spread of an axis
+is below 40% of that of the other two, the tool says so and keeps that axis out of the fit:
+its offset is the median reading and its semi axis the mean of the other two (scale 1). That
+is enough for a flat azimuth, but not for tilt compensation. With two such axes it gives up.
+
+The log is mapped into memory and every pass over it is split over the cores, each core
+summing its own part of the normal equations.
+
+The log is a binary log written by QMC5883LLogWriter (see QMC5883LLog.h), whose samples are
+used in place, leaving out failed reads and damaged blocks. A flat file of samples also
+works, each the raw X, Y and Z as 16 bit little endian integers (6 bytes), as written by:
+
+    compass.read();
+    int16_t xyz[3] = { (int16_t)compass.getX(), (int16_t)compass.getY(), (int16_t)compass.getZ() };
+    fwrite(xyz, sizeof(xyz), 1, file);
+
+on a compass without calibration. Build it from the library folder together with all .cpp
+files in src, e.g. with g++:
+
+    g++ -O2 -pthread -Isrc extras/linux/calibrate_log.cpp src/QMC5883L*.cpp -o calibrate_log
+    ./calibrate_log <log file> [threads]
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LLog.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+// Samples further from the ellipsoid than this many robust standard deviations are left out.
+#define TRIM_SIGMA 3.0
+#define TRIM_ROUNDS 10
+#define FIT_ITERATIONS 100
+// The fit is done when no value would move by this much, in sensor units.
+#define FIT_STEP 0.001
+// The median distance is found with a histogram over 0 - 1 (relative to the ellipsoid size).
+#define BINS 65536
+// An axis with less spread than this, relative to the mean of the other two, is not fitted.
+#define COVERAGE 0.4
+
+// Centre and semi axes of the ellipsoid.
+struct Ellipsoid {
+  double centre[3];
+  double axis[3];
+};
+
+// What one thread adds up in a pass, on its own cache lines.
+struct alignas(64) Sums {
+  double jtj[6][6];
+  double jtr[6];
+  double cost;
+  unsigned long count;
+};
+
+// The samples of a flat log, or of each block of a binary log (nullptr for damaged blocks).
+// Samples are numbered 0 - count, valid marks the ones that were read.
+struct Log {
+  const int16_t *xyz;
+  std::vector<const QMC5883LLogRecord *> blocks;
+  std::vector<uint8_t> valid;
+  size_t count;
+  size_t samples;
+};
+
+static unsigned int threads = 1;
+static const char axisNames[] = "XYZ";
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Run work(thread, first, end) on every thread for its part of the samples.
+template <typename F>
+static void parallel(size_t count, F work) {
+  std::vector<std::thread> pool;
+  for ( unsigned int t = 0; t < threads; t++ ) {
+    pool.emplace_back(work, t, count * t / threads, count * (t + 1) / threads);
+  }
+  for ( std::thread &thread : pool ) thread.join();
+}
+
+// Distance of a sample from the ellipsoid, relative to its size, and its derivatives.
+static inline const int16_t *sample(const Log &log, size_t i) {
+  if ( log.xyz ) return log.xyz + 3 * i;
+  size_t block = i / QMC5883L_LOG_RECORDS;
+  return &log.blocks[block][i - block * QMC5883L_LOG_RECORDS].x;
+}
+
+static inline bool distance(const Ellipsoid &e, const double *inverse, const int16_t *sample, double *r, double *j) {
+  double d[3];
+  double u = 0;
+  for ( int k = 0; k < 3; k++ ) {
+    d[k] = (sample[k] - e.centre[k]) * inverse[k];
+    u += d[k] * d[k];
+  }
+  if ( u <= 0 ) return false;
+  double length = sqrt(u);
+  *r = length - 1;
+  if ( j ) {
+    double f = 1 / length;
+    for ( int k = 0; k < 3; k++ ) {
+      j[k] = -d[k] * inverse[k] * f;
+      j[k + 3] = j[k] * d[k];
+    }
+  }
+  return true;
+}
+
+static void inverseAxes(const Ellipsoid &e, double *inverse) {
+  for ( int k = 0; k < 3; k++ ) inverse[k] = 1 / e.axis[k];
+}
+
+// One pass over the log: the normal equations and the cost of the samples that are used.
+static Sums normals(const Log &log, const std::vector<uint8_t> &used, const Ellipsoid &e) {
+  std::vector<Sums> sums(threads);
+  double inverse[3];
+  inverseAxes(e, inverse);
+  parallel(log.count, [&](unsigned int t, size_t first, size_t end) {
+    Sums s;
+    memset(&s, 0, sizeof(s));
+    double r, j[6];
+    for ( size_t i = first; i < end; i++ ) {
+      if ( !used[i] || !distance(e, inverse, sample(log, i), &r, j) ) continue;
+      for ( int a = 0; a < 6; a++ ) {
+        for ( int b = a; b < 6; b++ ) s.jtj[a][b] += j[a] * j[b];
+        s.jtr[a] += j[a] * r;
+      }
+      s.cost += r * r;
+      s.count++;
+    }
+    sums[t] = s;
+  });
+
+  Sums total = sums[0];
+  for ( unsigned int t = 1; t < threads; t++ ) {
+    for ( int a = 0; a < 6; a++ ) {
+      for ( int b = a; b < 6; b++ ) total.jtj[a][b] += sums[t].jtj[a][b];
+      total.jtr[a] += sums[t].jtr[a];
+    }
+    total.cost += sums[t].cost;
+    total.count += sums[t].count;
+  }
+  for ( int a = 0; a < 6; a++ ) {
+    for ( int b = 0; b < a; b++ ) total.jtj[a][b] = total.jtj[b][a];
+  }
+  return total;
+}
+
+// Solve the 6 x 6 system a * x = b with Gaussian elimination.
+static bool solve(double a[6][6], double b[6], double x[6]) {
+  for ( int c = 0; c < 6; c++ ) {
+    int pivot = c;
+    for ( int r = c + 1; r < 6; r++ ) {
+      if ( fabs(a[r][c]) > fabs(a[pivot][c]) ) pivot = r;
+    }
+    if ( a[pivot][c] == 0 ) return false;
+    for ( int k = 0; k < 6; k++ ) {
+      double swap = a[c][k];
+      a[c][k] = a[pivot][k];
+      a[pivot][k] = swap;
+    }
+    double swap = b[c];
+    b[c] = b[pivot];
+    b[pivot] = swap;
+    for ( int r = c + 1; r < 6; r++ ) {
+      double f = a[r][c] / a[c][c];
+      for ( int k = c; k < 6; k++ ) a[r][k] -= f * a[c][k];
+      b[r] -= f * b[c];
+    }
+  }
+  for ( int c = 5; c >= 0; c-- ) {
+    double sum = b[c];
+    for ( int k = c + 1; k < 6; k++ ) sum -= a[c][k] * x[k];
+    x[c] = sum / a[c][c];
+  }
+  return true;
+}
+
+// Levenberg-Marquardt on the samples that are used, starting at e, leaving the centre and
+// semi axis of pinned axes as they are. Returns the passes made.
+static int fit(const Log &log, const std::vector<uint8_t> &used, const bool *pinned, Ellipsoid *e, Sums *result) {
+  Sums current = normals(log, used, *e);
+  int passes = 1;
+  double lambda = 1e-3;
+
+  for ( int iteration = 0; iteration < FIT_ITERATIONS && current.count >= 6; iteration++ ) {
+    double a[6][6], b[6], step[6];
+    for ( int r = 0; r < 6; r++ ) {
+      for ( int c = 0; c < 6; c++ ) a[r][c] = current.jtj[r][c];
+      a[r][r] += lambda * current.jtj[r][r];
+      b[r] = -current.jtr[r];
+    }
+    for ( int k = 0; k < 3; k++ ) {
+      if ( !pinned[k] ) continue;
+      for ( int p = k; p < 6; p += 3 ) {
+        for ( int c = 0; c < 6; c++ ) a[p][c] = a[c][p] = 0;
+        a[p][p] = 1;
+        b[p] = 0;
+      }
+    }
+    if ( !solve(a, b, step) ) break;
+    double largest = 0;
+    for ( int k = 0; k < 6; k++ ) largest = fmax(largest, fabs(step[k]));
+    if ( largest < FIT_STEP ) break;
+
+    Ellipsoid candidate = *e;
+    bool valid = true;
+    for ( int k = 0; k < 3; k++ ) {
+      candidate.centre[k] += step[k];
+      candidate.axis[k] += step[k + 3];
+      if ( candidate.axis[k] <= 0 ) valid = false;
+    }
+    if ( !valid ) {
+      lambda *= 10;
+      continue;
+    }
+
+    Sums next = normals(log, used, candidate);
+    passes++;
+    if ( next.cost < current.cost ) {
+      double gain = (current.cost - next.cost) / current.cost;
+      *e = candidate;
+      current = next;
+      lambda = fmax(lambda / 10, 1e-12);
+      if ( gain < 1e-15 ) break;
+    } else {
+      lambda *= 10;
+      if ( lambda > 1e12 ) break;
+    }
+  }
+  *result = current;
+  return passes;
+}
+
+// Use the samples within TRIM_SIGMA robust standard deviations of the ellipsoid.
+static unsigned long trim(const Log &log, std::vector<uint8_t> *used, const Ellipsoid &e) {
+  std::vector<std::vector<uint32_t>> histograms(threads, std::vector<uint32_t>(BINS));
+  double inverse[3];
+  inverseAxes(e, inverse);
+  parallel(log.count, [&](unsigned int t, size_t first, size_t end) {
+    uint32_t *histogram = histograms[t].data();
+    double r;
+    for ( size_t i = first; i < end; i++ ) {
+      if ( !log.valid[i] ) continue;
+      if ( !distance(e, inverse, sample(log, i), &r, nullptr) ) r = 1;
+      size_t bin = (size_t)(fabs(r) * BINS);
+      histogram[bin < BINS ? bin : BINS - 1]++;
+    }
+  });
+
+  unsigned long half = log.samples / 2;
+  unsigned long sum = 0;
+  size_t median = 0;
+  while ( median < BINS - 1 ) {
+    for ( unsigned int t = 0; t < threads; t++ ) sum += histograms[t][median];
+    if ( sum > half ) break;
+    median++;
+  }
+  // 1.4826 times the median absolute distance estimates the standard deviation.
+  double limit = TRIM_SIGMA * 1.4826 * (median + 0.5) / BINS;
+
+  std::vector<unsigned long> counts(threads);
+  parallel(log.count, [&](unsigned int t, size_t first, size_t end) {
+    unsigned long count = 0;
+    double r;
+    for ( size_t i = first; i < end; i++ ) {
+      bool use = log.valid[i] && distance(e, inverse, sample(log, i), &r, nullptr) && fabs(r) <= limit;
+      (*used)[i] = use;
+      count += use;
+    }
+    counts[t] = count;
+  });
+  unsigned long count = 0;
+  for ( unsigned long c : counts ) count += c;
+  return count;
+}
+
+// Start from the median of each axis and the median distance from it, which unlike min / max
+// or the mean are not moved by spikes.
+static Ellipsoid start(const Log &log) {
+  std::vector<std::vector<uint32_t>> histograms(threads, std::vector<uint32_t>(3 * 65536));
+  parallel(log.count, [&](unsigned int t, size_t first, size_t end) {
+    uint32_t *histogram = histograms[t].data();
+    for ( size_t i = first; i < end; i++ ) {
+      if ( !log.valid[i] ) continue;
+      const int16_t *xyz = sample(log, i);
+      for ( int k = 0; k < 3; k++ ) histogram[k * 65536 + (xyz[k] + 32768)]++;
+    }
+  });
+
+  Ellipsoid e;
+  unsigned long half = log.samples / 2;
+  std::vector<unsigned long> counts(65536);
+  for ( int k = 0; k < 3; k++ ) {
+    for ( long v = 0; v < 65536; v++ ) {
+      counts[v] = 0;
+      for ( unsigned int t = 0; t < threads; t++ ) counts[v] += histograms[t][k * 65536 + v];
+    }
+    long median = 0;
+    unsigned long sum = counts[0];
+    while ( sum <= half ) sum += counts[++median];
+
+    // Widen a window around the median until it holds half of the samples.
+    long distance = 0;
+    sum = counts[median];
+    while ( sum <= half ) {
+      distance++;
+      if ( median - distance >= 0 ) sum += counts[median - distance];
+      if ( median + distance < 65536 ) sum += counts[median + distance];
+    }
+    e.centre[k] = median - 32768;
+    // Samples spread over a sphere are spread evenly along each axis, so half of them are
+    // within half of the radius.
+    e.axis[k] = distance > 0 ? 2 * distance : 1;
+  }
+  return e;
+}
+
+// Set the semi axis of pinned axes to the mean of the fitted ones.
+static void pin(Ellipsoid *e, const bool *pinned) {
+  double sum = 0;
+  int fitted = 0;
+  for ( int k = 0; k < 3; k++ ) {
+    if ( pinned[k] ) continue;
+    sum += e->axis[k];
+    fitted++;
+  }
+  for ( int k = 0; k < 3; k++ ) {
+    if ( pinned[k] ) e->axis[k] = sum / fitted;
+  }
+}
+
+int main(int argc, char **argv) {
+  if ( argc < 2 ) {
+    fprintf(stderr, "usage: %s <log file> [threads]\n", argv[0]);
+    return 1;
+  }
+  long requested = argc > 2 ? atol(argv[2]) : (long)std::thread::hardware_concurrency();
+  if ( argc > 2 && (requested <= 0 || requested > 1024) ) {
+    fprintf(stderr, "%s: the number of threads must be 1 - 1024\n", argv[2]);
+    return 1;
+  }
+  threads = requested > 0 ? (unsigned int)requested : 1;
+
+  Log log;
+  QMC5883LLogReader reader;
+  void *map = MAP_FAILED;
+  size_t size = 0;
+  if ( reader.open(argv[1]) ) {
+    log.xyz = nullptr;
+    log.blocks.resize(reader.getBlocks());
+    log.count = log.blocks.size() * QMC5883L_LOG_RECORDS;
+    log.valid.resize(log.count);
+    std::vector<unsigned long> counts(threads);
+    parallel(log.blocks.size(), [&](unsigned int t, size_t first, size_t end) {
+      unsigned long count = 0;
+      for ( size_t b = first; b < end; b++ ) {
+        byte records;
+        log.blocks[b] = reader.getRecords(b, &records);
+        for ( byte i = 0; i < records; i++ ) {
+          bool ok = !(log.blocks[b][i].flags & QMC5883L_LOG_FAILED);
+          log.valid[b * QMC5883L_LOG_RECORDS + i] = ok;
+          count += ok;
+        }
+      }
+      counts[t] = count;
+    });
+    log.samples = 0;
+    for ( unsigned long c : counts ) log.samples += c;
+  } else {
+    int file = open(argv[1], O_RDONLY);
+    struct stat info;
+    if ( file < 0 || fstat(file, &info) < 0 ) {
+      perror(argv[1]);
+      return 1;
+    }
+    size = (size_t)info.st_size;
+    if ( size >= 6 ) map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if ( map == MAP_FAILED ) {
+      fprintf(stderr, "%s: can not be mapped\n", argv[1]);
+      return 1;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+    log.xyz = (const int16_t *)map;
+    log.count = size / 6;
+    log.samples = log.count;
+    log.valid.assign(log.count, 1);
+  }
+  if ( log.samples < 6 ) {
+    fprintf(stderr, "%s: not enough samples\n", argv[1]);
+    return 1;
+  }
+
+  double begin = now();
+  std::vector<uint8_t> used = log.valid;
+  Ellipsoid e = start(log);
+
+  // The start has the spread of each axis. Pin the ones that are hardly covered.
+  bool pinned[3] = {false, false, false};
+  int fittedAxes = 3;
+  for ( int k = 0; k < 3; k++ ) {
+    double others = (e.axis[(k + 1) % 3] + e.axis[(k + 2) % 3]) / 2;
+    if ( e.axis[k] < COVERAGE * others ) {
+      pinned[k] = true;
+      fittedAxes--;
+      fprintf(stderr, "%c covers only %.0f%% of the spread of the other axes, e.g. as the compass stayed level.\n"
+        "%c can not be calibrated from this log: its offset is the median reading and its scale 1,\n"
+        "which is enough for a flat azimuth, but not for tilt compensation.\n", axisNames[k],
+        e.axis[k] * 100 / others, axisNames[k]);
+    }
+  }
+  if ( fittedAxes < 2 ) {
+    fprintf(stderr, "%s: the samples cover too little of the sphere to calibrate, turn the compass more\n", argv[1]);
+    return 1;
+  }
+  // Start pinned axes at the size of the others. Their samples are near the median, so they
+  // hardly change the fit of the others.
+  pin(&e, pinned);
+  Sums result;
+  int passes = 1;
+  unsigned long count = log.samples;
+  for ( int round = 0; round < TRIM_ROUNDS; round++ ) {
+    unsigned long trimmed = trim(log, &used, e);
+    passes += 2;
+    bool settled = labs((long)trimmed - (long)count) <= (long)(log.samples / 1000);
+    count = trimmed;
+    passes += fit(log, used, pinned, &e, &result);
+    if ( settled ) break;
+  }
+  double seconds = now() - begin;
+
+  pin(&e, pinned);
+
+  // The compass scales every axis to the mean of the three semi axes.
+  double mean = (e.axis[0] + e.axis[1] + e.axis[2]) / 3;
+  printf("compass.setCalibrationOffsets(%.2f, %.2f, %.2f);\n", e.centre[0], e.centre[1], e.centre[2]);
+  printf("compass.setCalibrationScales(%.4f, %.4f, %.4f);\n", mean / e.axis[0], mean / e.axis[1], mean / e.axis[2]);
+  printf("\n");
+  printf("field strength    %.0f\n", mean);
+  printf("residual          %.2f%% RMS\n", result.count ? sqrt(result.cost / result.count) * 100 : 0.);
+  printf("samples used      %lu of %zu (%.2f%%)\n", result.count, log.samples, result.count * 100. / log.samples);
+  printf("passes            %d on %u threads in %.2f s, %.1f M samples/s\n",
+    passes, threads, seconds, (double)passes * log.count / seconds / 1e6);
+
+  if ( map != MAP_FAILED ) munmap(map, size);
+  return 0;
+}
@@ -0,0 +1,203 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Calibration Test
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Checks the fixed point calibration of read() against the float calculation it replaced,
+round((raw - offset) * scale), for every 16 bit input on each axis, with typical, extreme
+and random offsets and scales. The fixed point result must be exactly the 64 bit product of
+the rounded coefficients, and at most 1 away from the float result. It also times the library,
+a plain 64 bit multiply and the float calculation on this machine. Build it from the library
+folder together with all .cpp files in src, without -mavx2 or -msse4.1 so the batch uses the
+same code as read(), once as it is and once with the 16 x 16 bit multiplies used on 8 bit AVR,
+e.g. with g++:
+
+    g++ -O2 -Isrc extras/linux/calibration_test.cpp src/QMC5883L*.cpp -o calibration_test
+    g++ -O2 -DQMC5883L_CALIBRATION_16BIT ...
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LBatch.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+static uint32_t seed = 12345;
+
+static float randomFloat(float low, float high) {
+  seed = seed * 1664525 + 1013904223;
+  return low + (high - low) * (seed >> 8) / 16777216.f;
+}
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static int16_t clamp16(long value) {
+  if ( value > INT16_MAX ) return INT16_MAX;
+  if ( value < INT16_MIN ) return INT16_MIN;
+  return (int16_t)value;
+}
+
+// The float calculation of earlier versions, limited to 16 bit like the fixed point one. Not
+// inlined, so it is timed as a call per value like the library.
+__attribute__((noinline)) static int16_t floatCalibrated(int16_t raw, float offset, float scale) {
+  float value = round((raw - offset) * scale);
+  if ( value > INT16_MAX ) return INT16_MAX;
+  if ( value < INT16_MIN ) return INT16_MIN;
+  return (int16_t)value;
+}
+
+// The coefficients as the library rounds them, and the exact result with a 64 bit multiply.
+struct Fixed {
+  int32_t offset;
+  int32_t scale;
+
+  Fixed(float o, float s) {
+    double q = o * 256.;
+    if ( q > 1073741823. ) q = 1073741823.;
+    if ( q < -1073741823. ) q = -1073741823.;
+    offset = (int32_t)round(q);
+    q = s * 16777216.;
+    if ( q > 2147483520. ) q = 2147483520.;
+    if ( q < -2147483520. ) q = -2147483520.;
+    scale = (int32_t)round(q);
+  }
+
+  __attribute__((noinline)) int16_t calibrated(int16_t raw) const {
+    int64_t product = (int64_t)((int32_t)raw * 256 - offset) * scale;
+    if ( product >= 0 ) return clamp16((long)((product + ((int64_t)1 << 31)) >> 32));
+    return clamp16(-(long)((-product + ((int64_t)1 << 31)) >> 32));
+  }
+};
+
+struct Result {
+  unsigned long inputs;
+  unsigned long exactErrors;
+  unsigned long floatDifferent;
+  long floatWorst;
+};
+
+// Every 16 bit input on all three axes, each axis with its own offset and scale.
+static void check(const float *offset, const float *scale, Result *result) {
+  QMC5883LCompass compass;
+  compass.setCalibrationOffsets(offset[0], offset[1], offset[2]);
+  compass.setCalibrationScales(scale[0], scale[1], scale[2]);
+  Fixed fixed[3] = {Fixed(offset[0], scale[0]), Fixed(offset[1], scale[1]), Fixed(offset[2], scale[2])};
+
+  for ( long v = INT16_MIN; v <= INT16_MAX; v++ ) {
+    int16_t raw = (int16_t)v;
+    QMC5883LRawSample sample = {0, raw, raw, raw, INT16_MIN, 0};
+    compass.process(&sample);
+    int values[3] = {compass.getX(), compass.getY(), compass.getZ()};
+    for ( int axis = 0; axis < 3; axis++ ) {
+      result->inputs++;
+      if ( values[axis] != fixed[axis].calibrated(raw) ) {
+        if ( result->exactErrors++ < 5 ) {
+          printf("  raw %d, offset %f, scale %f: %d, exact %d\n", raw, offset[axis], scale[axis], values[axis],
+            fixed[axis].calibrated(raw));
+        }
+      }
+      long difference = labs((long)values[axis] - floatCalibrated(raw, offset[axis], scale[axis]));
+      if ( difference > 0 ) result->floatDifferent++;
+      if ( difference > result->floatWorst ) result->floatWorst = difference;
+    }
+  }
+}
+
+static bool report(const char *name, const Result &r) {
+  printf("%-28s %9lu inputs, %lu not exact, %lu (%.4f%%) differ from float, at most by %ld\n", name, r.inputs,
+    r.exactErrors, r.floatDifferent, 100. * r.floatDifferent / r.inputs, r.floatWorst);
+  return r.exactErrors == 0 && r.floatWorst <= 1;
+}
+
+int main() {
+  bool ok = true;
+
+  Result typical = {};
+  const float offsets[][3] = {{-312.4, 1045.75, 77.1}, {0, 0, 0}, {-812, 1345, -230}, {0.5, -0.5, 1.5}};
+  const float scales[][3] = {{1.137, 0.912, 1.004}, {1, 1, 1}, {1.069, 0.9394, 1}, {0.75, 1.25, 1.5}};
+  for ( int i = 0; i < 4; i++ ) check(offsets[i], scales[i], &typical);
+  ok &= report("typical", typical);
+
+  // Offsets from setCalibration() are halves, scales are ratios of axis ranges.
+  Result ranges = {};
+  for ( int i = 0; i < 50; i++ ) {
+    int low[3], high[3];
+    float offset[3], scale[3], average = 0;
+    for ( int axis = 0; axis < 3; axis++ ) {
+      low[axis] = (int)randomFloat(-6000, -500);
+      high[axis] = (int)randomFloat(500, 6000);
+      offset[axis] = (low[axis] + high[axis]) / 2.f;
+      average += (high[axis] - low[axis]) / 2.f / 3;
+    }
+    for ( int axis = 0; axis < 3; axis++ ) scale[axis] = average / ((high[axis] - low[axis]) / 2.f);
+    check(offset, scale, &ranges);
+  }
+  ok &= report("from setCalibration()", ranges);
+
+  Result random = {};
+  for ( int i = 0; i < 200; i++ ) {
+    float offset[3], scale[3];
+    for ( int axis = 0; axis < 3; axis++ ) {
+      offset[axis] = randomFloat(-8000, 8000);
+      scale[axis] = randomFloat(0.25, 4);
+    }
+    check(offset, scale, &random);
+  }
+  ok &= report("random", random);
+
+  Result extreme = {};
+  const float extremeOffsets[][3] = {{-4000000., 3999999.5, 0.25}, {4194303., -4194303., 32767.5}, {-32768, 32767, 0.00390625}};
+  const float extremeScales[][3] = {{-1.5, 127.9, 0.0001}, {127.99999, -127.99999, 0}, {1e-7, -0.5, 64}};
+  for ( int i = 0; i < 3; i++ ) check(extremeOffsets[i], extremeScales[i], &extreme);
+  ok &= report("extreme", extreme);
+
+  // Time the three ways over the whole 16 bit range, many times.
+  const int rounds = 300;
+  std::vector<int16_t> input(65536), output(65536);
+  for ( long v = INT16_MIN; v <= INT16_MAX; v++ ) input[v - INT16_MIN] = (int16_t)v;
+  QMC5883LCompass compass;
+  compass.setCalibrationOffsets(-312.4, 1045.75, 77.1);
+  compass.setCalibrationScales(1.137, 0.912, 1.004);
+  Fixed fixed(-312.4, 1.137);
+  long sum = 0;
+
+  double start = now();
+  for ( int r = 0; r < rounds; r++ ) {
+    QMC5883LBatch::calibrate(&compass, input.data(), input.data(), input.data(), output.data(), output.data(), output.data(), 65536);
+    sum += output[r];
+  }
+  double library = (now() - start) / 3;
+  start = now();
+  for ( int r = 0; r < rounds; r++ ) {
+    for ( int i = 0; i < 65536; i++ ) output[i] = fixed.calibrated(input[i]);
+    sum += output[r];
+  }
+  double wide = now() - start;
+  start = now();
+  for ( int r = 0; r < rounds; r++ ) {
+    for ( int i = 0; i < 65536; i++ ) output[i] = floatCalibrated(input[i], -312.4, 1.137);
+    sum += output[r];
+  }
+  double single = now() - start;
+
+  double samples = 65536. * rounds;
+#ifdef QMC5883L_CALIBRATION_16BIT
+  const char *built = "16 x 16 bit multiplies";
+#else
+  const char *built = "64 bit multiply";
+#endif
+  printf("\nns per value on this machine, library built with %s (batch %s): library %.2f, 64 bit multiply %.2f, float %.2f (%ld)\n",
+    built, QMC5883LBatch::getInstructionSet(), library / samples * 1e9, wide / samples * 1e9, single / samples * 1e9, sum % 10);
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,33 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Linux Example
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Reads a compass on /dev/i2c-1 (or the bus given on the command line) and prints the azimuth.
+Build it from the library folder together with all .cpp files in src, e.g. with g++:
+
+    g++ -O2 -Isrc extras/linux/compass.cpp src/QMC5883L*.cpp -o compass
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <stdio.h>
+
+int main(int argc, char **argv) {
+  TwoWire bus(argc > 1 ? argv[1] : "/dev/i2c-1");
+  QMC5883LCompass compass;
+  compass.init(&bus);
+
+  while ( true ) {
+    compass.read();
+    if ( compass.getReadErrors() > 0 ) {
+      fprintf(stderr, "No answer from the compass\n");
+    } else {
+      printf("X: %d Y: %d Z: %d Azimuth: %d\n", compass.getX(), compass.getY(), compass.getZ(), compass.getAzimuth());
+    }
+    delay(250);
+  }
+}
@@ -0,0 +1,254 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Fusion Replay
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Runs QMC5883LFusion on simulated trajectories with a known true orientation: a gyro and an
+accelerometer at 200Hz with noise and a gyro bias, and a simulated compass read through the
+library at 50Hz, with the hard iron offset its calibration removes. For each trajectory it
+reports when the orientation error last went above 5 degrees, and the RMS and largest
+orientation error after the first 30 seconds, and fails when one of them is above the limit
+of the trajectory. At the end it times update() with and without the compass.
+
+                settled by  RMS    largest
+    still       2 s         1      2        lying still, level and North
+    start       2 s         3      5        lying still, turned 120 degrees and a little tilted
+    turns       2 s         1      2        driving around: slow turns with some pitch and roll
+    tumble      2 s         1.5    4        turning about all axes at up to 1 rad/s
+    magnet      90 s        8      20       slow turns, a magnet pulls the field away at 60 - 70 s
+
+The filter starts from the first sample, so every trajectory should be within 5 degrees from
+the start. The gyro has a bias of 0.7 degrees/s, which the filter learns while it runs; until
+it has, start is held off by a few degrees. After the magnet the filter needs some seconds to
+unlearn what it took for gyro bias. The limits are for the default beta of 0.1 and zeta of
+0.005.
+
+Build it from the library folder together with all .cpp files in src, e.g. with g++:
+
+    g++ -O2 -pthread -Isrc extras/linux/fusion_replay.cpp src/QMC5883L*.cpp -o fusion_replay
+    ./fusion_replay [beta] [zeta]
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LFusion.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <random>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define RATE 200
+#define COMPASS_EVERY 4
+#define SECONDS 120
+#define SETTLED 5.0
+
+struct Quaternion {
+  double w, x, y, z;
+};
+
+static Quaternion multiply(const Quaternion &a, const Quaternion &b) {
+  return {a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+          a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+          a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+          a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w};
+}
+
+// An earth frame vector as the sensor sees it.
+static void toSensor(const Quaternion &q, const double *earth, double *sensor) {
+  Quaternion v = {0, earth[0], earth[1], earth[2]};
+  Quaternion conjugate = {q.w, -q.x, -q.y, -q.z};
+  Quaternion r = multiply(multiply(conjugate, v), q);
+  sensor[0] = r.x;
+  sensor[1] = r.y;
+  sensor[2] = r.z;
+}
+
+// Simulated compass on the bus: the field set here, in sensor units, plus a hard iron offset.
+static const double hardIron[3] = {-420, 260, 135};
+static double field[3];
+static uint8_t registers[16];
+static uint8_t pointer;
+static std::mt19937 noise(7);
+
+static int simulate(int, unsigned long request, void *argument) {
+  if ( request != I2C_RDWR ) {
+    errno = EINVAL;
+    return -1;
+  }
+  i2c_rdwr_ioctl_data *transaction = (i2c_rdwr_ioctl_data *)argument;
+  std::normal_distribution<double> sensorNoise(0, 4);
+  for ( unsigned int i = 0; i < transaction->nmsgs; i++ ) {
+    i2c_msg &message = transaction->msgs[i];
+    if ( message.flags & I2C_M_RD ) {
+      if ( pointer == 0 ) {
+        int16_t xyz[3];
+        for ( int k = 0; k < 3; k++ ) xyz[k] = (int16_t)lround(field[k] + hardIron[k] + sensorNoise(noise));
+        memcpy(registers, xyz, 6);
+        registers[6] = 1;
+      }
+      for ( int k = 0; k < message.len; k++ ) message.buf[k] = registers[(pointer + k) % 16];
+    } else if ( message.len > 0 ) {
+      pointer = message.buf[0];
+    }
+  }
+  return (int)transaction->nmsgs;
+}
+
+enum Trajectory { STILL, START, TURNS, TUMBLE, MAGNET };
+
+// Body rates in rad/s at time t.
+static void rates(Trajectory trajectory, double t, double *w) {
+  switch ( trajectory ) {
+    case STILL:
+    case START:
+      w[0] = w[1] = w[2] = 0;
+      break;
+    case TURNS:
+    case MAGNET:
+      w[0] = 0.05 * sin(0.7 * t);
+      w[1] = 0.04 * sin(0.45 * t + 1);
+      w[2] = 0.3 * sin(0.08 * t) + 0.1 * sin(0.5 * t);
+      break;
+    case TUMBLE:
+      w[0] = 0.6 * sin(0.3 * t);
+      w[1] = 0.5 * sin(0.21 * t + 1);
+      w[2] = 0.8 * sin(0.13 * t) + 0.3;
+      break;
+  }
+}
+
+static double angleBetween(const Quaternion &truth, const float *q) {
+  double dot = fabs(q[0] * truth.w + q[1] * truth.x + q[2] * truth.y + q[3] * truth.z);
+  return 2 * acos(dot > 1 ? 1 : dot) * 180 / M_PI;
+}
+
+struct Limits {
+  double settled;
+  double rms;
+  double largest;
+};
+
+static bool run(const char *name, Trajectory trajectory, const Limits &limits, float beta, float zeta) {
+  TwoWire bus("/dev/null");
+  bus.setIoctl(simulate);
+  QMC5883LCompass compass;
+  compass.init(&bus);
+  compass.setCalibrationOffsets(hardIron[0], hardIron[1], hardIron[2]);
+  QMC5883LFusion fusion;
+  fusion.setBeta(beta);
+  fusion.setZeta(zeta);
+
+  std::normal_distribution<double> gyroNoise(0, 0.005);
+  std::normal_distribution<double> accelNoise(0, 0.01);
+  const double gyroBias[3] = {0.01, -0.006, 0.004};
+  // Earth field with X to magnetic North and Z up, in sensor units (3000 per gauss).
+  const double earthField[3] = {600, 0, -1350};
+  const double gravity[3] = {0, 0, 1};
+  const double dt = 1. / RATE;
+
+  // Level and North, except for the start: 120 degrees around Z and a little tilted.
+  Quaternion truth = {1, 0, 0, 0};
+  if ( trajectory == START ) truth = {cos(1.05), 0.05, -0.03, sin(1.05)};
+  double settled = -1;
+  double sumSquares = 0;
+  double worst = 0;
+  long counted = 0;
+
+  for ( long k = 0; k < (long)SECONDS * RATE; k++ ) {
+    double t = k * dt;
+    double w[3];
+    rates(trajectory, t, w);
+    Quaternion spin = multiply(truth, {0, w[0], w[1], w[2]});
+    truth = {truth.w + 0.5 * spin.w * dt, truth.x + 0.5 * spin.x * dt, truth.y + 0.5 * spin.y * dt, truth.z + 0.5 * spin.z * dt};
+    double length = sqrt(truth.w * truth.w + truth.x * truth.x + truth.y * truth.y + truth.z * truth.z);
+    truth = {truth.w / length, truth.x / length, truth.y / length, truth.z / length};
+
+    double a[3];
+    toSensor(truth, gravity, a);
+    float gx = w[0] + gyroBias[0] + gyroNoise(noise);
+    float gy = w[1] + gyroBias[1] + gyroNoise(noise);
+    float gz = w[2] + gyroBias[2] + gyroNoise(noise);
+    float ax = a[0] + accelNoise(noise);
+    float ay = a[1] + accelNoise(noise);
+    float az = a[2] + accelNoise(noise);
+
+    if ( k % COMPASS_EVERY == 0 ) {
+      double m[3] = {earthField[0], earthField[1], earthField[2]};
+      if ( trajectory == MAGNET && t >= 60 && t < 70 ) m[1] += 400;
+      toSensor(truth, m, field);
+      compass.read();
+      fusion.update(compass, gx, gy, gz, ax, ay, az, dt);
+    } else {
+      fusion.updateIMU(gx, gy, gz, ax, ay, az, dt);
+    }
+
+    float q[4];
+    fusion.getQuaternion(q);
+    double error = angleBetween(truth, q);
+    if ( error > SETTLED ) {
+      settled = -1;
+    } else if ( settled < 0 ) {
+      settled = t;
+    }
+    if ( t >= 30 ) {
+      sumSquares += error * error;
+      counted++;
+      if ( error > worst ) worst = error;
+    }
+  }
+
+  double rms = sqrt(sumSquares / counted);
+  bool ok = settled >= 0 && settled <= limits.settled && rms <= limits.rms && worst <= limits.largest;
+  if ( settled < 0 ) {
+    printf("%-8s not within %.0f degrees at the end, ", name, SETTLED);
+  } else {
+    printf("%-8s within %.0f degrees from %5.1f s on, ", name, SETTLED, settled);
+  }
+  printf("after 30 s: RMS error %5.2f, largest %6.2f degrees  %s\n", rms, worst, ok ? "PASS" : "FAIL");
+  return ok;
+}
+
+static double now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  float beta = argc > 1 ? atof(argv[1]) : 0.1;
+  float zeta = argc > 2 ? atof(argv[2]) : 0.005;
+  printf("QMC5883LFusion, beta %.3f, zeta %.4f, gyro %dHz, compass %dHz, %d s per trajectory\n", beta, zeta, RATE, RATE / COMPASS_EVERY, SECONDS);
+  bool ok = true;
+  ok &= run("still", STILL, {2, 1, 2}, beta, zeta);
+  ok &= run("start", START, {2, 3, 5}, beta, zeta);
+  ok &= run("turns", TURNS, {2, 1, 2}, beta, zeta);
+  ok &= run("tumble", TUMBLE, {2, 1.5, 4}, beta, zeta);
+  ok &= run("magnet", MAGNET, {90, 8, 20}, beta, zeta);
+
+  // Cost of one update on this machine, without the bus.
+  const long n = 2000000;
+  QMC5883LFusion fusion;
+  volatile float sink = 0;
+  double start = now();
+  for ( long i = 0; i < n; i++ ) {
+    fusion.update(0.01f, 0.02f, 0.03f, 0.f, 0.1f, 1.f, 600.f, 0.f, -1350.f, 0.005f);
+    sink = sink + fusion.getHeading();
+  }
+  double full = (now() - start) / n;
+  start = now();
+  for ( long i = 0; i < n; i++ ) {
+    fusion.updateIMU(0.01f, 0.02f, 0.03f, 0.f, 0.1f, 1.f, 0.005f);
+  }
+  double imu = (now() - start) / n;
+  printf("ns per update on this machine: with compass %.1f (including getHeading()), without %.1f\n", full * 1e9, imu * 1e9);
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,245 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Linux Backend Test
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Tests the TwoWire class of the Linux backend against a mock ioctl() that records every
+I2C_RDWR transaction and can fail the next one with a chosen errno: plain writes, the combined
+write and read after endTransmission(false), requestFrom() lengths and the 32 byte limit, the
+Arduino error codes for a NACK and for other errors, a bus that is not open, and a compass
+read on top of it. Build it from the library folder together with all .cpp files in src,
+e.g. with g++:
+
+    g++ -O2 -pthread -Isrc extras/linux/linux_test.cpp src/QMC5883L*.cpp -o linux_test
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+// What the mock saw of one message.
+struct Message {
+  uint16_t addr;
+  uint16_t flags;
+  uint16_t len;
+  uint8_t data[64];
+};
+
+static std::vector<std::vector<Message> > transactions;
+static int failWith = 0;
+static uint8_t registers[16];
+
+static int mock(int, unsigned long request, void *argument) {
+  if ( request != I2C_RDWR ) {
+    errno = EINVAL;
+    return -1;
+  }
+  i2c_rdwr_ioctl_data *transaction = (i2c_rdwr_ioctl_data *)argument;
+  std::vector<Message> seen;
+  for ( unsigned int i = 0; i < transaction->nmsgs; i++ ) {
+    i2c_msg &message = transaction->msgs[i];
+    Message m = {message.addr, message.flags, message.len, {0}};
+    if ( message.flags & I2C_M_RD ) {
+      for ( int k = 0; k < message.len; k++ ) message.buf[k] = registers[k % 16] + k / 16;
+    }
+    memcpy(m.data, message.buf, message.len < 64 ? message.len : 64);
+    seen.push_back(m);
+  }
+  transactions.push_back(seen);
+  if ( failWith ) {
+    errno = failWith;
+    failWith = 0;
+    return -1;
+  }
+  return (int)transaction->nmsgs;
+}
+
+static int failures = 0;
+
+#define CHECK(condition) check(condition, #condition, __LINE__)
+
+static void check(bool ok, const char *what, int line) {
+  if ( !ok ) {
+    printf("  FAILED line %d: %s\n", line, what);
+    failures++;
+  }
+}
+
+static void test(const char *name) {
+  printf("%s\n", name);
+  transactions.clear();
+  failWith = 0;
+}
+
+int main() {
+  for ( int i = 0; i < 16; i++ ) registers[i] = 0x10 + i;
+  TwoWire bus("/dev/null");
+  bus.setIoctl(mock);
+
+  test("not open: no transfer, error 4");
+  bus.beginTransmission(0x0D);
+  bus.write(0x01);
+  CHECK(bus.endTransmission() == 4);
+  CHECK(bus.requestFrom(0x0D, 6) == 0);
+  CHECK(transactions.empty());
+  bus.begin();
+
+  test("write: one message with the bytes");
+  bus.beginTransmission(0x0D);
+  CHECK(bus.write(0x0B) == 1);
+  CHECK(bus.write(0x01) == 1);
+  CHECK(bus.endTransmission() == 0);
+  CHECK(transactions.size() == 1 && transactions[0].size() == 1);
+  CHECK(transactions[0][0].addr == 0x0D && transactions[0][0].flags == 0 && transactions[0][0].len == 2);
+  CHECK(transactions[0][0].data[0] == 0x0B && transactions[0][0].data[1] == 0x01);
+
+  test("write: at most 32 bytes");
+  uint8_t many[40] = {0};
+  bus.beginTransmission(0x0D);
+  CHECK(bus.write(many, 40) == 32);
+  CHECK(bus.write(0x01) == 0);
+  CHECK(bus.endTransmission() == 0);
+  CHECK(transactions.size() == 1 && transactions[0][0].len == 32);
+
+  test("endTransmission(false): nothing sent until requestFrom()");
+  bus.beginTransmission(0x0D);
+  bus.write(0x00);
+  CHECK(bus.endTransmission(false) == 0);
+  CHECK(transactions.empty());
+
+  test("requestFrom() after it: one combined transaction, write then read");
+  CHECK(bus.requestFrom(0x0D, 6) == 6);
+  CHECK(transactions.size() == 1 && transactions[0].size() == 2);
+  CHECK(transactions[0][0].addr == 0x0D && !(transactions[0][0].flags & I2C_M_RD) && transactions[0][0].len == 1);
+  CHECK(transactions[0][0].data[0] == 0x00);
+  CHECK(transactions[0][1].addr == 0x0D && (transactions[0][1].flags & I2C_M_RD) && transactions[0][1].len == 6);
+  CHECK(bus.available() == 6);
+  bool inOrder = true;
+  for ( int k = 0; k < 6; k++ ) inOrder &= bus.read() == 0x10 + k;
+  CHECK(inOrder);
+  CHECK(bus.available() == 0 && bus.read() == -1);
+
+  test("requestFrom() without a pending write: read only");
+  CHECK(bus.requestFrom(0x0D, 1) == 1);
+  CHECK(transactions.size() == 1 && transactions[0].size() == 1 && (transactions[0][0].flags & I2C_M_RD));
+
+  test("requestFrom() another address: the pending write goes on its own");
+  bus.beginTransmission(0x70);
+  bus.write(0x04);
+  bus.endTransmission(false);
+  CHECK(bus.requestFrom(0x0D, 2) == 2);
+  CHECK(transactions.size() == 2 && transactions[0].size() == 1 && transactions[1].size() == 1);
+  CHECK(transactions[0][0].addr == 0x70 && transactions[1][0].addr == 0x0D);
+
+  test("beginTransmission() drops a pending write");
+  bus.beginTransmission(0x0D);
+  bus.write(0x09);
+  bus.endTransmission(false);
+  bus.beginTransmission(0x0D);
+  CHECK(bus.requestFrom(0x0D, 1) == 1);
+  CHECK(transactions.size() == 1 && transactions[0].size() == 1);
+
+  test("requestFrom() lengths: 1, 9, 32, and more clamped to 32");
+  const uint8_t asked[] = {1, 9, 32, 33, 255};
+  const uint8_t got[] = {1, 9, 32, 32, 32};
+  for ( int i = 0; i < 5; i++ ) {
+    transactions.clear();
+    CHECK(bus.requestFrom(0x0D, asked[i]) == got[i]);
+    CHECK(transactions.size() == 1 && transactions[0][0].len == got[i]);
+    CHECK(bus.available() == got[i]);
+  }
+  bool last = true;
+  for ( int k = 0; k < 32; k++ ) last &= bus.read() == registers[k % 16] + k / 16;
+  CHECK(last);
+
+  test("NACK: ENXIO, EREMOTEIO and EIO are error 2");
+  const int nack[] = {ENXIO, EREMOTEIO, EIO};
+  for ( int error : nack ) {
+    failWith = error;
+    bus.beginTransmission(0x0D);
+    bus.write(0x0B);
+    CHECK(bus.endTransmission() == 2);
+  }
+
+  test("other errors: ETIMEDOUT, EAGAIN and EINVAL are error 4");
+  const int other[] = {ETIMEDOUT, EAGAIN, EINVAL};
+  for ( int error : other ) {
+    failWith = error;
+    bus.beginTransmission(0x0D);
+    bus.write(0x0B);
+    CHECK(bus.endTransmission() == 4);
+  }
+
+  test("failed combined transaction: requestFrom() returns 0 and nothing to read");
+  CHECK(bus.requestFrom(0x0D, 4) == 4);
+  bus.beginTransmission(0x0D);
+  bus.write(0x00);
+  bus.endTransmission(false);
+  failWith = ENXIO;
+  CHECK(bus.requestFrom(0x0D, 6) == 0);
+  CHECK(transactions.size() == 2 && transactions[1].size() == 2);
+  CHECK(bus.available() == 0 && bus.read() == -1);
+
+  test("failed write to another address: requestFrom() returns 0 without reading");
+  bus.beginTransmission(0x70);
+  bus.write(0x04);
+  bus.endTransmission(false);
+  failWith = ENXIO;
+  CHECK(bus.requestFrom(0x0D, 6) == 0);
+  CHECK(transactions.size() == 1);
+
+  test("compass read: one combined transaction of the data registers");
+  int16_t xyz[3] = {1234, -567, -2000};
+  memcpy(registers, xyz, 6);
+  QMC5883LCompass compass;
+  compass.init(&bus);
+  transactions.clear();
+  compass.read();
+  CHECK(transactions.size() == 1 && transactions[0].size() == 2);
+  CHECK(transactions[0][0].len == 1 && transactions[0][0].data[0] == 0x00 && transactions[0][1].len == 6);
+  CHECK(compass.getReadErrors() == 0);
+  CHECK(compass.getX() == 1234 && compass.getY() == -567 && compass.getZ() == -2000);
+
+  test("compass read with temperature: 9 bytes");
+  compass.enableTemperature(true);
+  transactions.clear();
+  compass.read();
+  CHECK(transactions.size() == 1 && transactions[0][1].len == 9);
+  compass.enableTemperature(false);
+
+  test("compass read NACKed: counted, last sample kept");
+  failWith = ENXIO;
+  compass.read();
+  failWith = EIO;
+  compass.read();
+  CHECK(compass.getReadErrors() == 2);
+  CHECK(compass.getX() == 1234);
+  compass.read();
+  CHECK(compass.getReadErrors() == 0);
+
+  test("setIoctl(nullptr): back to the real ioctl(), which /dev/null refuses with error 4");
+  bus.setIoctl(nullptr);
+  bus.beginTransmission(0x0D);
+  bus.write(0x0B);
+  CHECK(bus.endTransmission() == 4);
+  CHECK(transactions.empty());
+
+  test("device that does not exist: error 4");
+  TwoWire missing("/nonexistent/i2c-9");
+  missing.setIoctl(mock);
+  missing.begin();
+  missing.beginTransmission(0x0D);
+  CHECK(missing.endTransmission() == 4);
+  CHECK(transactions.empty());
+
+  printf("%s, %d failed checks\n", failures == 0 ? "PASS" : "FAIL", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,196 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Lock Stress Test
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Hammers one simulated bus from several threads: two compasses on channels 1 and 2 of a
+TCA9548A multiplexer are read by a thread each, a third thread reads both the way a program
+with its own transactions would, holding a QMC5883LLock around the multiplexer switch and the
+read (which the recursive lock lets the library lock again inside), and three more threads
+take getSample() snapshots of the first compass while it is being read.
+
+The simulated adapter runs one I2C_RDWR at a time, like the kernel. Every sample of a channel
+has y = -x and z = x / 2 and x in the range of its channel, so a sample read from the wrong
+channel (the multiplexer switched by another thread between select and read) and a snapshot
+mixed from two samples are both found. Build it with a lock to see them all at 0, and without
+one to see what goes wrong:
+
+    g++ -O2 -pthread -DQMC5883L_LOCK_STD -Isrc extras/linux/lock_stress.cpp src/QMC5883L*.cpp -o lock_stress
+    g++ -O2 -pthread -Isrc extras/linux/lock_stress.cpp src/QMC5883L*.cpp -o lock_stress_unlocked
+    ./lock_stress [reads per thread]
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LMux.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+// Simulated bus: a multiplexer at 0x70 with a compass on channels 1 and 2.
+static std::mutex adapter;
+static uint8_t muxMask;
+static uint8_t pointer[8];
+static int16_t counter[8];
+static std::atomic<long> badFrames{0};
+
+static int16_t lowest(int channel) {
+  return channel == 1 ? 1000 : -3000;
+}
+
+static void fill(int channel, uint8_t *buffer, int length) {
+  int16_t x = lowest(channel) + counter[channel];
+  counter[channel] = (counter[channel] + 1) % 2000;
+  int16_t y = -x;
+  int16_t z = x / 2;
+  uint8_t registers[9] = {0};
+  memcpy(registers, &x, 2);
+  memcpy(registers + 2, &y, 2);
+  memcpy(registers + 4, &z, 2);
+  registers[6] = 1;
+  for ( int i = 0; i < length; i++ ) buffer[i] = registers[(pointer[channel] + i) % 9];
+}
+
+static int simulate(int, unsigned long request, void *argument) {
+  if ( request != I2C_RDWR ) {
+    errno = EINVAL;
+    return -1;
+  }
+  std::lock_guard<std::mutex> guard(adapter);
+  i2c_rdwr_ioctl_data *transaction = (i2c_rdwr_ioctl_data *)argument;
+  for ( unsigned int i = 0; i < transaction->nmsgs; i++ ) {
+    i2c_msg &message = transaction->msgs[i];
+    if ( message.addr == 0x70 ) {
+      if ( (message.flags & I2C_M_RD) || message.len != 1 ) {
+        badFrames++;
+        errno = EIO;
+        return -1;
+      }
+      muxMask = message.buf[0];
+      continue;
+    }
+
+    int channel = -1;
+    for ( int c = 1; c <= 2; c++ ) {
+      if ( muxMask == (1 << c) ) channel = c;
+    }
+    if ( message.addr != 0x0D || channel < 0 ) {
+      errno = ENXIO;
+      return -1;
+    }
+    if ( message.flags & I2C_M_RD ) {
+      fill(channel, message.buf, message.len);
+    } else if ( message.len < 1 || message.len > 2 ) {
+      badFrames++;
+      errno = EIO;
+      return -1;
+    } else {
+      pointer[channel] = message.buf[0];
+    }
+  }
+  // Some bus time, so the other threads get in while a transaction is running.
+  for ( volatile int spin = 0; spin < 200; spin++ ) {}
+  return (int)transaction->nmsgs;
+}
+
+struct Counters {
+  std::atomic<long> reads{0};
+  std::atomic<long> failed{0};
+  std::atomic<long> wrongChannel{0};
+  std::atomic<long> snapshots{0};
+  std::atomic<long> torn{0};
+};
+
+static Counters counters;
+
+static void checkReading(QMC5883LCompass *compass, int channel) {
+  counters.reads++;
+  if ( compass->getReadErrors() > 0 ) {
+    counters.failed++;
+    return;
+  }
+  int x = compass->getX();
+  if ( x < lowest(channel) || x >= lowest(channel) + 2000 ) counters.wrongChannel++;
+}
+
+static void reader(QMC5883LCompass *compass, int channel, long reads) {
+  for ( long n = 0; n < reads; n++ ) {
+    compass->read();
+    checkReading(compass, channel);
+  }
+}
+
+// Reads both compasses holding the lock itself, as a program with its own transactions would.
+static void ownTransactions(QMC5883LMux *mux, TwoWire *bus, QMC5883LCompass *a, QMC5883LCompass *b, long reads) {
+  for ( long n = 0; n < reads; n++ ) {
+    QMC5883LCompass *compass = ( n % 2 ) ? b : a;
+    int channel = ( n % 2 ) ? 2 : 1;
+    QMC5883LLock lock(bus);
+    mux->select(channel);
+    compass->read();
+    checkReading(compass, channel);
+  }
+}
+
+static void snapshots(QMC5883LCompass *compass, std::atomic<bool> *stop) {
+  QMC5883LSample sample;
+  while ( !*stop ) {
+    compass->getSample(&sample);
+    counters.snapshots++;
+    if ( sample.sequence == 0 ) continue;
+    if ( sample.y != -sample.x || sample.z != sample.x / 2 ) counters.torn++;
+  }
+}
+
+int main(int argc, char **argv) {
+  long reads = argc > 1 ? atol(argv[1]) : 100000;
+#if defined(QMC5883L_LOCK_STD)
+  bool locked = true;
+#else
+  bool locked = false;
+#endif
+
+  TwoWire bus("/dev/null");
+  bus.setIoctl(simulate);
+  bus.begin();
+  QMC5883LMux mux;
+  mux.init(&bus);
+  QMC5883LCompass a, b;
+  a.setMultiplexer(&mux, 1);
+  b.setMultiplexer(&mux, 2);
+  a.init(&bus);
+  b.init(&bus);
+
+  std::atomic<bool> stop{false};
+  std::thread watchers[3];
+  for ( std::thread &watcher : watchers ) watcher = std::thread(snapshots, &a, &stop);
+  std::thread readA(reader, &a, 1, reads);
+  std::thread readB(reader, &b, 2, reads);
+  std::thread own(ownTransactions, &mux, &bus, &a, &b, reads);
+  readA.join();
+  readB.join();
+  own.join();
+  stop = true;
+  for ( std::thread &watcher : watchers ) watcher.join();
+
+  printf("%s: %ld reads, %ld failed, %ld from the wrong channel, %ld bad frames, %ld snapshots, %ld torn, %lu mux writes\n",
+    locked ? "QMC5883L_LOCK_STD" : "no lock", counters.reads.load(), counters.failed.load(), counters.wrongChannel.load(),
+    badFrames.load(), counters.snapshots.load(), counters.torn.load(), mux.getSwitches());
+
+  bool ok = counters.failed == 0 && counters.wrongChannel == 0 && badFrames == 0 && counters.torn == 0;
+  if ( !locked ) {
+    printf("%s\n", ok ? "no errors this time, but without a lock nothing prevents them" : "errors as expected without a lock");
+    return 0;
+  }
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,166 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Log Record / Replay
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Records a compass into a binary log with QMC5883LLogWriter, and replays a log through the
+library with QMC5883LLogReplay. The replay prints a fingerprint of everything the compass
+made of the samples (calibrated and smoothed values, azimuth, field strength), so two builds of
+the library can be compared on the same recording, the recorded time it covers, which the
+replay gives the library through micros(), and the samples per second.
+
+    record <bus> <file> [seconds]     read a compass, e.g. on /dev/i2c-1, at 200Hz
+    record sim <file> [samples]       a simulated compass turning around, with spikes and failed reads
+    replay <file>                     replay a log as fast as possible
+
+Build it from the library folder together with all .cpp files in src, e.g. with g++:
+
+    g++ -O2 -pthread -Isrc extras/linux/log.cpp src/QMC5883L*.cpp -o log
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LLog.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+static size_t writeFile(const uint8_t *data, size_t length, void *context) {
+  return fwrite(data, 1, length, (FILE *)context);
+}
+
+// Simulated compass: a tilted sensor turning around, with hard and soft iron, noise, a spike
+// now and then and a failed read every 1000 samples.
+static uint8_t registers[16];
+static uint8_t pointer;
+static unsigned long simulatedSamples;
+
+static int simulate(int, unsigned long request, void *argument) {
+  if ( request != I2C_RDWR ) {
+    errno = EINVAL;
+    return -1;
+  }
+  i2c_rdwr_ioctl_data *transaction = (i2c_rdwr_ioctl_data *)argument;
+  for ( unsigned int i = 0; i < transaction->nmsgs; i++ ) {
+    i2c_msg &message = transaction->msgs[i];
+    if ( message.flags & I2C_M_RD ) {
+      if ( pointer == 0 ) {
+        unsigned long n = simulatedSamples++;
+        if ( n % 1000 == 999 ) {
+          errno = EIO;
+          return -1;
+        }
+        double heading = n * 0.0013;
+        double pitch = sin(n * 0.00071) * 1.2;
+        double field[3] = {cos(heading) * cos(pitch), sin(heading) * cos(pitch), sin(pitch)};
+        const double offset[3] = {-812, 1345, -230};
+        const double axis[3] = {2900, 3300, 3100};
+        int16_t xyz[3];
+        for ( int k = 0; k < 3; k++ ) {
+          double v = offset[k] + axis[k] * field[k] + (rand() % 31 - 15);
+          if ( rand() % 500 == 0 ) v += rand() % 20001 - 10000;
+          xyz[k] = (int16_t)fmax(-32768, fmin(32767, v));
+        }
+        int16_t temperature = 2150 + (int16_t)(n / 2000 % 100);
+        memcpy(registers, xyz, 6);
+        registers[6] = 1;
+        memcpy(registers + 7, &temperature, 2);
+      }
+      for ( int k = 0; k < message.len; k++ ) message.buf[k] = registers[(pointer + k) % 16];
+    } else if ( message.len > 0 ) {
+      pointer = message.buf[0];
+    }
+  }
+  return (int)transaction->nmsgs;
+}
+
+static int record(const char *device, const char *path, double amount) {
+  bool simulated = strcmp(device, "sim") == 0;
+  FILE *file = fopen(path, "wb");
+  if ( !file ) {
+    perror(path);
+    return 1;
+  }
+
+  TwoWire bus(simulated ? "/dev/null" : device);
+  if ( simulated ) bus.setIoctl(simulate);
+  QMC5883LCompass compass;
+  compass.init(&bus);
+  compass.enableTemperature(true);
+
+  QMC5883LLogWriter log;
+  log.begin(writeFile, file);
+  if ( simulated ) {
+    for ( unsigned long i = 0; i < (unsigned long)amount; i++ ) log.read(&compass);
+  } else {
+    unsigned long start = millis();
+    while ( millis() - start < amount * 1000 ) {
+      while ( !compass.isDataReady() ) delayMicroseconds(500);
+      log.read(&compass);
+    }
+  }
+  log.end();
+  fclose(file);
+  printf("%lu samples in %s, %lu write errors\n", log.getRecords(), path, log.getErrors());
+  return 0;
+}
+
+static int replay(const char *path) {
+  QMC5883LLogReader log;
+  if ( !log.open(path) ) {
+    fprintf(stderr, "%s: not a compass log\n", path);
+    return 1;
+  }
+
+  TwoWire bus("/dev/null");
+  QMC5883LLogReplay replay;
+  replay.begin(&log, &bus);
+  QMC5883LCompass compass;
+  compass.init(&bus);
+  compass.enableTemperature(true);
+  compass.setCalibrationOffsets(-812, 1345, -230);
+  compass.setCalibrationScales(1.069, 0.9394, 1);
+  compass.setSmoothing(5, true);
+
+  // FNV-1a over what the compass made of every sample.
+  uint32_t fingerprint = 2166136261u;
+  unsigned long failed = 0;
+  unsigned long first = micros();
+  struct timespec begin, end;
+  clock_gettime(CLOCK_MONOTONIC, &begin);
+  while ( replay.available() ) {
+    compass.read();
+    if ( compass.getReadErrors() > 0 ) failed++;
+    int values[6] = {compass.getX(), compass.getY(), compass.getZ(), compass.getAzimuthCentidegrees(),
+                     (int)compass.getFieldStrength(), compass.getTemperature()};
+    for ( int v : values ) {
+      fingerprint = (fingerprint ^ (uint32_t)v) * 16777619u;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+  double recorded = (micros() - first) / 1e6;
+
+  printf("%lu samples replayed, %lu failed reads, fingerprint %08x\n", replay.getReplayed(), failed, fingerprint);
+  printf("%.2f s of recording in %.2f s, %.0f samples/s\n", recorded, seconds, replay.getReplayed() / seconds);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if ( argc >= 4 && strcmp(argv[1], "record") == 0 ) {
+    return record(argv[2], argv[3], argc > 4 ? atof(argv[4]) : ( strcmp(argv[2], "sim") == 0 ? 100000 : 10 ));
+  }
+  if ( argc >= 3 && strcmp(argv[1], "replay") == 0 ) {
+    return replay(argv[2]);
+  }
+  fprintf(stderr, "usage: %s record <bus|sim> <file> [seconds|samples]\n       %s replay <file>\n", argv[0], argv[0]);
+  return 1;
+}
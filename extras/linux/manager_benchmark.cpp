@@ -0,0 +1,290 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Manager Benchmark
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Runs QMC5883LManager on simulated buses with TCA9548A multiplexers and compasses behind them,
+each transaction taking as long as on a 400kHz bus, and reports for a few layouts how many
+time aligned sets per second the manager delivers, the bus time and multiplexer writes per
+set, and how the 200Hz schedule holds up. Every simulated compass has its own Z value, so a
+reading from the wrong channel is counted, and a read while two channels answer at once fails.
+Then one compass fails every third read, and each set must mark it as not valid and hold its
+last good reading. It fails on any wrong reading, collision or failed read that is not flagged.
+
+    ./manager_benchmark [seconds per run]
+
+Build it from the library folder together with all .cpp files in src, e.g. with g++:
+
+    g++ -O2 -pthread -Isrc extras/linux/manager_benchmark.cpp src/QMC5883L*.cpp -o manager_benchmark
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LManager.h>
+#include <QMC5883LMux.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+#define SENSORS 16
+#define BUSES 2
+#define MUXES 2
+
+struct Sensor {
+  uint8_t registers[16];
+  uint8_t pointer;
+  unsigned long samples;
+  unsigned long reads;
+  unsigned long failEvery;
+  unsigned long failures;
+  int16_t z;
+};
+
+// One simulated bus: a compass directly on it, or up to MUXES multiplexers with a compass on
+// some of their channels.
+struct Bus {
+  Sensor *direct;
+  Sensor *channel[MUXES][8];
+  uint8_t mask[MUXES];
+  unsigned long micros;
+  unsigned long muxWrites;
+  unsigned long collisions;
+};
+
+static Bus buses[BUSES];
+
+static void spin(unsigned long microseconds) {
+  unsigned long start = micros();
+  while ( micros() - start < microseconds ) {}
+}
+
+static Sensor *connected(Bus &bus, int *count) {
+  Sensor *found = bus.direct;
+  *count = bus.direct ? 1 : 0;
+  for ( int m = 0; m < MUXES; m++ ) {
+    for ( int c = 0; c < 8; c++ ) {
+      if ( (bus.mask[m] & (1 << c)) && bus.channel[m][c] ) {
+        found = bus.channel[m][c];
+        (*count)++;
+      }
+    }
+  }
+  return found;
+}
+
+static int transfer(Bus &bus, unsigned long request, void *argument) {
+  if ( request != I2C_RDWR ) {
+    errno = EINVAL;
+    return -1;
+  }
+  i2c_rdwr_ioctl_data *transaction = (i2c_rdwr_ioctl_data *)argument;
+  unsigned long bits = 0;
+  int result = (int)transaction->nmsgs;
+  for ( unsigned int i = 0; i < transaction->nmsgs && result > 0; i++ ) {
+    i2c_msg &message = transaction->msgs[i];
+    bits += (message.len + 1) * 9 + 2;
+    int mux = message.addr - 0x70;
+
+    if ( mux >= 0 && mux < MUXES ) {
+      if ( message.flags & I2C_M_RD ) {
+        for ( int k = 0; k < message.len; k++ ) message.buf[k] = bus.mask[mux];
+      } else if ( message.len > 0 ) {
+        bus.mask[mux] = message.buf[0];
+        bus.muxWrites++;
+      }
+      continue;
+    }
+
+    int count;
+    Sensor *sensor = connected(bus, &count);
+    if ( message.addr != 0x0D || count == 0 ) {
+      errno = ENXIO;
+      result = -1;
+    } else if ( count > 1 ) {
+      bus.collisions++;
+      errno = EIO;
+      result = -1;
+    } else if ( (message.flags & I2C_M_RD) && sensor->failEvery && ++sensor->reads % sensor->failEvery == 0 ) {
+      sensor->failures++;
+      errno = ENXIO;
+      result = -1;
+    } else if ( message.flags & I2C_M_RD ) {
+      if ( sensor->pointer == 0 ) {
+        float angle = sensor->samples++ * 0.01;
+        int16_t field[3] = {(int16_t)(1500 * cos(angle)), (int16_t)(1500 * sin(angle)), sensor->z};
+        memcpy(sensor->registers, field, 6);
+        sensor->registers[6] = 1;
+      }
+      for ( int k = 0; k < message.len; k++ ) message.buf[k] = sensor->registers[(sensor->pointer + k) % 16];
+    } else if ( message.len > 0 ) {
+      sensor->pointer = message.buf[0];
+    }
+  }
+  unsigned long time = bits * 1000000 / 400000;
+  bus.micros += time;
+  spin(time);
+  return result;
+}
+
+template <int B>
+static int simulate(int, unsigned long request, void *argument) {
+  return transfer(buses[B], request, argument);
+}
+
+struct Layout {
+  const char *name;
+  int buses;
+  int muxes;
+  int perMux;
+};
+
+static bool run(const Layout &layout, unsigned long interval, double seconds) {
+  static Sensor sensors[SENSORS];
+  memset(buses, 0, sizeof(buses));
+  memset(sensors, 0, sizeof(sensors));
+
+  TwoWire wire0("/dev/null");
+  TwoWire wire1("/dev/null");
+  TwoWire *wire[BUSES] = {&wire0, &wire1};
+  wire0.setIoctl(simulate<0>);
+  wire1.setIoctl(simulate<1>);
+  QMC5883LMux mux[BUSES][MUXES];
+  QMC5883LManager<SENSORS> manager;
+
+  // Attach the sensors in the worst order, channel by channel across the multiplexers, so the
+  // manager has to sort them.
+  int count = 0;
+  for ( int b = 0; b < layout.buses; b++ ) {
+    wire[b]->begin();
+    for ( int m = 0; m < layout.muxes; m++ ) {
+      mux[b][m].setADDR(0x70 + m);
+      mux[b][m].init(wire[b]);
+    }
+  }
+  for ( int c = 0; c < (layout.muxes ? layout.perMux : 1); c++ ) {
+    for ( int m = 0; m < (layout.muxes ? layout.muxes : 1); m++ ) {
+      for ( int b = 0; b < layout.buses; b++ ) {
+        Sensor *sensor = &sensors[count];
+        sensor->z = -2000 + 100 * count;
+        if ( layout.muxes ) {
+          buses[b].channel[m][c] = sensor;
+          manager.attach(wire[b], &mux[b][m], c);
+        } else {
+          buses[b].direct = sensor;
+          manager.attach(wire[b]);
+        }
+        count++;
+      }
+    }
+  }
+  manager.setInterval(interval);
+  manager.init();
+
+  unsigned long busStart[BUSES], muxStart[BUSES];
+  for ( int b = 0; b < BUSES; b++ ) {
+    busStart[b] = buses[b].micros;
+    muxStart[b] = buses[b].muxWrites;
+  }
+  unsigned long cyclesStart = manager.getCycles();
+  unsigned long wrong = 0;
+  unsigned long failed = 0;
+  unsigned long start = micros();
+  while ( micros() - start < seconds * 1e6 ) {
+    if ( !manager.update() ) continue;
+    for ( int i = 0; i < count; i++ ) {
+      if ( !manager.isValid(i) ) failed++;
+      else if ( manager.getZ(i) != sensors[i].z ) wrong++;
+    }
+  }
+  double elapsed = (micros() - start) / 1e6;
+
+  unsigned long sets = manager.getCycles() - cyclesStart;
+  unsigned long busTime = 0, muxWrites = 0, collisions = 0;
+  for ( int b = 0; b < BUSES; b++ ) {
+    busTime += buses[b].micros - busStart[b];
+    muxWrites += buses[b].muxWrites - muxStart[b];
+    collisions += buses[b].collisions;
+  }
+  printf("%-34s %2d sensors %7.1f sets/s %8.0f reads/s %6.0f us bus/set %5.2f mux writes/set %6lu overruns, %lu failed, %lu wrong, %lu collisions\n",
+    layout.name, count, sets / elapsed, sets * count / elapsed, sets ? (double)busTime / sets : 0.,
+    sets ? (double)muxWrites / sets : 0., manager.getOverruns(), failed, wrong, collisions);
+  return failed == 0 && wrong == 0 && collisions == 0;
+}
+
+// Two sensors on their own buses, the second failing every third read. A failed read must be
+// flagged, counted, and leave the last good reading in the set instead of a new timestamp on
+// old data.
+static bool failing(double seconds) {
+  static Sensor sensors[2];
+  memset(buses, 0, sizeof(buses));
+  memset(sensors, 0, sizeof(sensors));
+  sensors[1].failEvery = 3;
+  buses[0].direct = &sensors[0];
+  buses[1].direct = &sensors[1];
+
+  TwoWire wire0("/dev/null");
+  TwoWire wire1("/dev/null");
+  wire0.setIoctl(simulate<0>);
+  wire1.setIoctl(simulate<1>);
+  wire0.begin();
+  wire1.begin();
+  QMC5883LManager<2> manager;
+  manager.attach(&wire0);
+  manager.attach(&wire1);
+  manager.init();
+
+  unsigned long invalid = 0, stale = 0, flaggedGood = 0, sets = 0;
+  unsigned long start = micros();
+  while ( micros() - start < seconds * 1e6 ) {
+    if ( !manager.update() ) continue;
+    sets++;
+    if ( !manager.isValid(0) ) flaggedGood++;
+    if ( manager.isValid(1) ) continue;
+    invalid++;
+    QMC5883LCompass &sensor = manager.getSensor(1);
+    if ( manager.getX(1) != sensor.getX() || manager.getY(1) != sensor.getY() ) stale++;
+  }
+
+  bool ok = invalid == sensors[1].failures && manager.getErrors(1) == sensors[1].failures && manager.getErrors(0) == 0 &&
+    flaggedGood == 0 && stale == 0 && invalid > 0;
+  printf("\none sensor failing every 3rd read: %lu sets, %lu failed reads, %lu flagged, %lu counted, %lu not holding the last good reading\n",
+    sets, sensors[1].failures, invalid, manager.getErrors(1), stale);
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  double seconds = argc > 1 ? atof(argv[1]) : 2;
+  const Layout layouts[] = {
+    {"1 bus",                          1, 0, 0},
+    {"2 buses",                        2, 0, 0},
+    {"1 bus, 1 mux",                   1, 1, 8},
+    {"1 bus, 2 muxes",                 1, 2, 8},
+    {"2 buses, 2 muxes each",          2, 2, 4},
+  };
+
+  printf("QMC5883LManager on simulated 400kHz buses\n\n200Hz schedule (5000 us interval):\n");
+  bool ok = true;
+  for ( const Layout &layout : layouts ) ok &= run(layout, 5000, seconds);
+  printf("\nas fast as the buses allow (sets back to back):\n");
+  for ( const Layout &layout : layouts ) ok &= run(layout, 1, seconds);
+  ok &= failing(seconds);
+
+  // A channel that does not exist must not reach another one.
+  TwoWire wire("/dev/null");
+  wire.setIoctl(simulate<0>);
+  wire.begin();
+  QMC5883LMux mux;
+  mux.init(&wire);
+  bool rejected = !mux.select(9);
+  printf("\nselect(9) %s\n", rejected ? "rejected" : "SELECTED A CHANNEL");
+  ok &= rejected;
+  printf("%s\n", ok ? "PASS" : "FAIL");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+/*
+===============================================================================================================
+QMC5883LCompass.h Library Pipeline Benchmark
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Compares reading and processing on one thread with QMC5883LPipeline, which reads on one thread
+and processes on another. Every sample runs a light workload (azimuth, field strength,
+inclination), and every few seconds a slow one that stands in for a calibration fit. The
+benchmark reports the throughput, the latency from the start of each read to the end of its
+processing, and how many read slots were missed. Run it with 0 ms of slow work to see how many
+slots the system misses by itself. It fails when the pipeline misses more slots than the single
+thread. On a single core that needs the real time priority of the reading thread, so run it as
+root or with CAP_SYS_NICE.
+
+Without arguments the compass is simulated, with the bus time of a 9 byte read at 400kHz.
+Give a bus, e.g. /dev/i2c-1, to use a real compass. Build it from the library folder
+together with all .cpp files in src, e.g. with g++:
+
+    g++ -O2 -pthread -Isrc extras/linux/pipeline_benchmark.cpp src/QMC5883L*.cpp -o pipeline_benchmark
+    ./pipeline_benchmark [bus] [seconds] [interval us] [slow work ms]
+
+===============================================================================================================
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+===============================================================================================================
+*/
+#include <QMC5883LCompass.h>
+#include <QMC5883LPipeline.h>
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+// Latencies are counted in 10us steps up to this many steps.
+#define STEPS 10000
+
+struct Statistics {
+  unsigned long latency[STEPS + 1];
+  unsigned long samples;
+  unsigned long failed;
+  unsigned long missed;
+  unsigned long last;
+  unsigned long interval;
+  unsigned long slowEvery;
+  unsigned long slowMicros;
+  volatile long sink;
+};
+
+static void count(unsigned long *histogram, unsigned long micros) {
+  unsigned long step = micros / 10;
+  histogram[step < STEPS ? step : STEPS]++;
+}
+
+static double percentile(const unsigned long *histogram, double p) {
+  unsigned long total = 0;
+  for ( int i = 0; i <= STEPS; i++ ) total += histogram[i];
+  unsigned long target = (unsigned long)ceil(total * p / 100.);
+  unsigned long sum = 0;
+  for ( int i = 0; i <= STEPS; i++ ) {
+    sum += histogram[i];
+    if ( sum >= target && sum > 0 ) return i * 10 / 1000.;
+  }
+  return 0;
+}
+
+static void spin(unsigned long microseconds) {
+  unsigned long start = micros();
+  while ( micros() - start < microseconds ) {}
+}
+
+// Simulated compass: the field turns slowly, each transaction takes as long as on a 400kHz bus.
+static uint8_t registers[16];
+static uint8_t pointer;
+static unsigned long simulatedSamples;
+
+static int simulate(int, unsigned long request, void *argument) {
+  if ( request != I2C_RDWR ) {
+    errno = EINVAL;
+    return -1;
+  }
+  i2c_rdwr_ioctl_data *transaction = (i2c_rdwr_ioctl_data *)argument;
+  unsigned long bits = 0;
+  for ( unsigned int i = 0; i < transaction->nmsgs; i++ ) {
+    i2c_msg &message = transaction->msgs[i];
+    bits += (message.len + 1) * 9 + 2;
+    if ( message.flags & I2C_M_RD ) {
+      if ( pointer == 0 ) {
+        float angle = simulatedSamples++ * 0.01;
+        int16_t field[3] = {(int16_t)(1500 * cos(angle)), (int16_t)(1500 * sin(angle)), -2000};
+        memcpy(registers, field, 6);
+        registers[6] = 1;
+      }
+      for ( int k = 0; k < message.len; k++ ) message.buf[k] = registers[(pointer + k) % 16];
+    } else if ( message.len > 0 ) {
+      pointer = message.buf[0];
+    }
+  }
+  spin(bits * 1000000 / 400000);
+  return (int)transaction->nmsgs;
+}
+
+// Runs for every processed sample, in either mode.
+static void work(QMC5883LCompass *compass, unsigned long timestamp, void *context) {
+  Statistics *s = (Statistics *)context;
+  if ( compass->getReadErrors() > 0 ) s->failed++;
+  s->sink += compass->getAzimuth() + compass->getFieldStrength() + compass->getInclination();
+
+  if ( s->samples > 0 && s->interval > 0 ) {
+    unsigned long gap = timestamp - s->last;
+    if ( gap > s->interval * 3 / 2 ) s->missed += (gap + s->interval / 2) / s->interval - 1;
+  }
+  s->last = timestamp;
+  s->samples++;
+
+  if ( s->slowEvery > 0 && s->samples % s->slowEvery == 0 ) spin(s->slowMicros);
+  count(s->latency, micros() - timestamp);
+}
+
+static void report(const char *name, Statistics *s, double seconds) {
+  printf("%-13s %8.1f samples/s  latency ms p50 %6.2f p90 %6.2f p99 %6.2f p99.9 %6.2f max %6.2f  missed slots %lu  failed %lu\n",
+    name, s->samples / seconds, percentile(s->latency, 50), percentile(s->latency, 90), percentile(s->latency, 99),
+    percentile(s->latency, 99.9), percentile(s->latency, 100), s->missed, s->failed);
+}
+
+static void sleepUntil(struct timespec *next, unsigned long interval) {
+  while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, nullptr) == EINTR ) {}
+  next->tv_nsec += (long)(interval % 1000000) * 1000L;
+  next->tv_sec += (time_t)(interval / 1000000) + next->tv_nsec / 1000000000L;
+  next->tv_nsec %= 1000000000L;
+}
+
+int main(int argc, char **argv) {
+  const char *device = ( argc > 1 && strcmp(argv[1], "sim") != 0 ) ? argv[1] : nullptr;
+  double seconds = argc > 2 ? atof(argv[2]) : 10;
+  unsigned long interval = argc > 3 ? strtoul(argv[3], nullptr, 10) : 5000;
+  unsigned long slowMillis = argc > 4 ? strtoul(argv[4], nullptr, 10) : 30;
+
+  TwoWire bus(device ? device : "/dev/null");
+  if ( !device ) bus.setIoctl(simulate);
+  QMC5883LCompass compass;
+  compass.init(&bus);
+  compass.setSmoothing(5, true);
+  compass.setFieldReference(2500, 53);
+
+  printf("%s, interval %lu us, %.0f s per run, %lu ms of slow work every 2 s\n",
+    device ? device : "simulated compass", interval, seconds, slowMillis);
+
+  static Statistics single, split;
+  Statistics *runs[2] = {&single, &split};
+  for ( Statistics *s : runs ) {
+    memset(s, 0, sizeof(Statistics));
+    s->interval = interval;
+    s->slowEvery = interval > 0 ? 2000000 / interval : 2000;
+    s->slowMicros = slowMillis * 1000;
+  }
+
+  // One thread: read, then process, on the same schedule as the pipeline.
+  struct timespec next;
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  unsigned long start = micros();
+  while ( micros() - start < seconds * 1e6 ) {
+    if ( interval > 0 ) sleepUntil(&next, interval);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ( (now.tv_sec - next.tv_sec) * 1000000000LL + (now.tv_nsec - next.tv_nsec) >= (long long)interval * 1000LL ) {
+      next = now;
+    }
+    QMC5883LRawSample raw;
+    bool ok = compass.readRaw(&raw);
+    if ( ok ) compass.process(&raw);
+    work(&compass, raw.timestamp, &single);
+  }
+  report("single thread", &single, (micros() - start) / 1e6);
+
+  QMC5883LPipeline pipeline;
+  pipeline.setInterval(interval);
+  pipeline.setCallback(work, &split);
+  start = micros();
+  pipeline.start(&compass);
+  delay((unsigned long)(seconds * 1000));
+  pipeline.stop();
+  report("pipeline", &split, (micros() - start) / 1e6);
+  printf("pipeline queue drops %lu, reader overruns %lu, reading thread %s\n", pipeline.getDropped(), pipeline.getOverruns(),
+    pipeline.isRealtime() ? "SCHED_FIFO" : "not real time (no permission)");
+
+  bool ok = split.missed <= single.missed;
+  printf("%s, pipeline missed %lu slots, single thread %lu\n", ok ? "PASS" : "FAIL", split.missed, single.missed);
+  return ok ? 0 : 1;
+}
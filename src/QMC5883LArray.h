@@ -0,0 +1,265 @@
+#ifndef QMC5883L_Array
+#define QMC5883L_Array
+
+#include "QMC5883LPlatform.h"
+#include "QMC5883LCompass.h"
+
+// Smallest mean square noise of a sensor in the array, keeps the weight of a perfect sensor finite.
+#define QMC5883L_ARRAY_NOISE_FLOOR 1.0
+
+/**
+	SENSOR ARRAY
+	Combines the calibrated fields of up to N compasses mounted together (same orientation)
+	into one. Averaging N sensors reduces the noise by about sqrt(N), and the array keeps
+	working when some of them fail.
+
+	Each sensor's weight is its calibration quality divided by its noise. The noise is the
+	running mean square difference between the sensor and the combined field of the other
+	sensors. This way, sensors that are noisy or badly calibrated count for less. A sensor is left out of the
+	current update when:
+
+	- its last read failed, @see QMC5883LCompass::getReadErrors()
+	- it is disturbed, @see QMC5883LCompass::isDisturbed()
+	- with 3 or more sensors left, it is further than @see setOutlierThreshold() from the
+	  median of all of them
+
+	Example:
+
+	QMC5883LArray<3> array;
+
+	array.add(&compass1);
+	array.add(&compass2);
+	array.add(&compass3);
+
+	compass1.read();
+	compass2.read();
+	compass3.read();
+	if ( array.update() ) {
+	  int a = array.getAzimuth();
+	}
+
+	With @see QMC5883LManager add &sensors.getSensor(i) and call update() whenever the
+	manager delivers a set.
+
+	@since v1.3.0
+**/
+template <byte N>
+class QMC5883LArray {
+public:
+    QMC5883LArray() {}
+
+    /**
+    	Add a compass. Its calibration quality is read here, call refreshQuality() after
+    	calibrating it again.
+
+    	@return byte index of the sensor, or 255 when all N places are taken
+    **/
+    byte add(QMC5883LCompass *compass) {
+        if ( _count >= N ) return 255;
+        _compass[_count] = compass;
+        _weight[_count] = -1;
+        _noise[_count] = QMC5883L_ARRAY_NOISE_FLOOR;
+        _used[_count] = false;
+        _quality[_count] = _readQuality(compass);
+        return _count++;
+    }
+
+    /**
+    	Read the calibration quality of every sensor again, @see QMC5883LCompass::getCalibrationQuality().
+    	Sensors without a quality score, @see QMC5883LCompass::hasCalibrationQuality(), count as 100,
+    	a score of 0 counts as 1.
+    **/
+    void refreshQuality() {
+        for ( byte i = 0; i < _count; i++ ) _quality[i] = _readQuality(_compass[i]);
+    }
+
+    /**
+    	Use a fixed weight for a sensor instead of its calibration quality, any positive value.
+    	A negative weight goes back to the calibration quality.
+    **/
+    void setWeight(byte index, float weight) {
+        _weight[index] = weight;
+    }
+
+    /**
+    	How far a sensor may be from the median of all sensors, in percent of the field strength,
+    	before it is left out. 25 by default, 0 turns the check off.
+    **/
+    void setOutlierThreshold(byte percent) {
+        _outlierThreshold = percent;
+    }
+
+    /**
+    	Combine the current readings of the sensors. Call it after reading them.
+
+    	@return bool false when no sensor could be used, the previous result is kept
+    **/
+    bool update() {
+        float field[3];
+        byte candidates = 0;
+        for ( byte i = 0; i < _count; i++ ) {
+            _used[i] = _compass[i]->getReadErrors() == 0 && !_compass[i]->isDisturbed();
+            if ( _used[i] ) candidates++;
+        }
+
+        if ( _outlierThreshold > 0 && candidates >= 3 ) {
+            _median(field);
+            float limit = sqrt(field[0] * field[0] + field[1] * field[1] + field[2] * field[2]) * _outlierThreshold / 100.;
+            for ( byte i = 0; i < _count; i++ ) {
+                if ( _used[i] && _distance(i, field) > limit ) {
+                    _used[i] = false;
+                    candidates--;
+                }
+            }
+        }
+        _usedCount = candidates;
+        if ( candidates == 0 ) return false;
+
+        float sum[3] = {0., 0., 0.};
+        float total = 0;
+        for ( byte i = 0; i < _count; i++ ) {
+            if ( !_used[i] ) continue;
+            float w = _weightOf(i);
+            sum[0] += w * _compass[i]->getX();
+            sum[1] += w * _compass[i]->getY();
+            sum[2] += w * _compass[i]->getZ();
+            total += w;
+        }
+        if ( total <= 0 ) {
+            _usedCount = 0;
+            return false;
+        }
+        for ( byte j = 0; j < 3; j++ ) {
+            field[j] = sum[j] / total;
+            _field[j] = (int16_t)round(field[j]);
+        }
+
+        // Follow the noise of every sensor that answered, used or not, so a sensor that comes
+        // back from a disturbance starts out with a low weight. A used sensor is compared with
+        // the combination of the others, comparing it with a combination it is part of would
+        // let the best sensor's weight run away. That needs at least 2 others to tell which
+        // sensor is the noisy one, with fewer the noise of the used sensors is kept as it is.
+        for ( byte i = 0; i < _count; i++ ) {
+            if ( _compass[i]->getReadErrors() > 0 ) continue;
+            float reference[3] = {field[0], field[1], field[2]};
+            if ( _used[i] ) {
+                if ( candidates < 3 ) continue;
+                float w = _weightOf(i);
+                reference[0] = (sum[0] - w * _compass[i]->getX()) / (total - w);
+                reference[1] = (sum[1] - w * _compass[i]->getY()) / (total - w);
+                reference[2] = (sum[2] - w * _compass[i]->getZ()) / (total - w);
+            }
+            float d = _distance(i, reference);
+            _noise[i] += (d * d + QMC5883L_ARRAY_NOISE_FLOOR - _noise[i]) / 32.;
+        }
+        return true;
+    }
+
+    /**
+    	Combined field of the latest update().
+    **/
+    int getX() {
+        return _field[0];
+    }
+
+    int getY() {
+        return _field[1];
+    }
+
+    int getZ() {
+        return _field[2];
+    }
+
+    /**
+    	Azimuth of the combined field in degrees, corrected with the magnetic declination of the
+    	first sensor in use, like QMC5883LCompass::getAzimuth(). Deviation tables belong to a
+    	single sensor and are not applied.
+    **/
+    int getAzimuth() {
+        long heading = QMC5883LCompass::_angle(_field[1], _field[0]);
+        for ( byte i = 0; i < _count; i++ ) {
+            if ( _used[i] ) {
+                heading += _compass[i]->_magneticDeclination;
+                break;
+            }
+        }
+        return (int)(heading / 100) % 360;
+    }
+
+    /**
+    	Number of sensors used in the latest update().
+    **/
+    byte getUsedCount() {
+        return _usedCount;
+    }
+
+    /**
+    	Whether a sensor was used in the latest update().
+    **/
+    bool isUsed(byte index) {
+        return _used[index];
+    }
+
+    /**
+    	RMS difference between a sensor and the combined field, in sensor units.
+    **/
+    float getNoise(byte index) {
+        return sqrt(_noise[index]);
+    }
+
+private:
+    QMC5883LCompass *_compass[N];
+    float _weight[N];
+    float _noise[N];
+    int16_t _field[3] = {0, 0, 0};
+    byte _quality[N];
+    byte _count = 0;
+    byte _usedCount = 0;
+    byte _outlierThreshold = 25;
+    bool _used[N];
+
+    float _weightOf(byte index) {
+        float w = ( _weight[index] >= 0 ) ? _weight[index] : _quality[index];
+        return w / _noise[index];
+    }
+
+    /**
+    	A sensor without a quality score keeps the full weight, a scored one gets its quality with
+    	at least 1, so a bad calibration counts for little but the sensor is not dropped.
+    **/
+    static byte _readQuality(QMC5883LCompass *compass) {
+        if ( !compass->hasCalibrationQuality() ) return 100;
+        byte quality = compass->getCalibrationQuality();
+        return ( quality > 0 ) ? quality : 1;
+    }
+
+    float _distance(byte index, const float *field) {
+        float dx = _compass[index]->getX() - field[0];
+        float dy = _compass[index]->getY() - field[1];
+        float dz = _compass[index]->getZ() - field[2];
+        return sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    /**
+    	Median of every axis over the sensors in use, with an insertion sort as N is small.
+    **/
+    void _median(float *field) {
+        for ( byte j = 0; j < 3; j++ ) {
+            int16_t values[N];
+            byte n = 0;
+            for ( byte i = 0; i < _count; i++ ) {
+                if ( !_used[i] ) continue;
+                int16_t v = (int16_t)( j == 0 ? _compass[i]->getX() : j == 1 ? _compass[i]->getY() : _compass[i]->getZ() );
+                byte k = n++;
+                while ( k > 0 && values[k - 1] > v ) {
+                    values[k] = values[k - 1];
+                    k--;
+                }
+                values[k] = v;
+            }
+            field[j] = ( n % 2 ) ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2.;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,296 @@
+/*
+===============================================================================================================
+QMC5883LBatch.h
+Batch calibration, field strength and azimuth for the QMC5883L Compass library.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LBatch.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define QMC5883L_BATCH_SIMD "AVX2"
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#define QMC5883L_BATCH_SIMD "SSE4.1"
+#endif
+
+#ifdef QMC5883L_BATCH_SIMD
+
+/*
+	The few vector operations the kernels need, on 32 bit lanes. The kernels below are written
+	once against these and work with either instruction set.
+*/
+#if defined(__AVX2__)
+typedef __m256i VI;
+typedef __m256 VF;
+static const size_t LANES = 8;
+
+static inline VI vLoad(const int16_t *p) { return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p)); }
+static inline VI vSet(int32_t v) { return _mm256_set1_epi32(v); }
+static inline VI vAdd(VI a, VI b) { return _mm256_add_epi32(a, b); }
+static inline VI vSub(VI a, VI b) { return _mm256_sub_epi32(a, b); }
+static inline VI vMul(VI a, VI b) { return _mm256_mullo_epi32(a, b); }
+static inline VI vAnd(VI a, VI b) { return _mm256_and_si256(a, b); }
+static inline VI vXor(VI a, VI b) { return _mm256_xor_si256(a, b); }
+static inline VI vGt(VI a, VI b) { return _mm256_cmpgt_epi32(a, b); }
+static inline VI vMin(VI a, VI b) { return _mm256_min_epi32(a, b); }
+static inline VI vMax(VI a, VI b) { return _mm256_max_epi32(a, b); }
+static inline VI vAbs(VI a) { return _mm256_abs_epi32(a); }
+static inline VI vBlend(VI a, VI b, VI mask) { return _mm256_blendv_epi8(a, b, mask); }
+static inline VI vShiftLeft(VI a, int n) { return _mm256_slli_epi32(a, n); }
+static inline VI vShiftRight(VI a, int n) { return _mm256_srli_epi32(a, n); }
+static inline VI vShiftRightSigned(VI a, int n) { return _mm256_srai_epi32(a, n); }
+static inline VF vFloat(VI a) { return _mm256_cvtepi32_ps(a); }
+static inline VI vTruncate(VF a) { return _mm256_cvttps_epi32(a); }
+static inline VF vAddF(VF a, VF b) { return _mm256_add_ps(a, b); }
+static inline VF vMulF(VF a, VF b) { return _mm256_mul_ps(a, b); }
+static inline VF vDivF(VF a, VF b) { return _mm256_div_ps(a, b); }
+static inline VF vSqrtF(VF a) { return _mm256_sqrt_ps(a); }
+static inline VI vGather(const int32_t *table, VI index) { return _mm256_i32gather_epi32((const int *)table, index, 4); }
+
+static inline void vStore(int16_t *p, VI v) {
+    // The packs work per 128 bit half, gather both results into the low half.
+    _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi32(v, v), 0x08)));
+}
+
+static inline void vStoreUnsigned(uint16_t *p, VI v) {
+    _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi32(v, v), 0x08)));
+}
+
+// (a * b + 2^31) >> 32 of unsigned lanes, the multiply works on the even lanes only.
+static inline VI vMulRound(VI a, VI b) {
+    const __m256i half = _mm256_set1_epi64x(1LL << 31);
+    __m256i even = _mm256_add_epi64(_mm256_mul_epu32(a, b), half);
+    __m256i odd = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32)), half);
+    return _mm256_blend_epi32(_mm256_srli_epi64(even, 32), odd, 0xAA);
+}
+#else
+typedef __m128i VI;
+typedef __m128 VF;
+static const size_t LANES = 4;
+
+static inline VI vLoad(const int16_t *p) { return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)p)); }
+static inline VI vSet(int32_t v) { return _mm_set1_epi32(v); }
+static inline VI vAdd(VI a, VI b) { return _mm_add_epi32(a, b); }
+static inline VI vSub(VI a, VI b) { return _mm_sub_epi32(a, b); }
+static inline VI vMul(VI a, VI b) { return _mm_mullo_epi32(a, b); }
+static inline VI vAnd(VI a, VI b) { return _mm_and_si128(a, b); }
+static inline VI vXor(VI a, VI b) { return _mm_xor_si128(a, b); }
+static inline VI vGt(VI a, VI b) { return _mm_cmpgt_epi32(a, b); }
+static inline VI vMin(VI a, VI b) { return _mm_min_epi32(a, b); }
+static inline VI vMax(VI a, VI b) { return _mm_max_epi32(a, b); }
+static inline VI vAbs(VI a) { return _mm_abs_epi32(a); }
+static inline VI vBlend(VI a, VI b, VI mask) { return _mm_blendv_epi8(a, b, mask); }
+static inline VI vShiftLeft(VI a, int n) { return _mm_slli_epi32(a, n); }
+static inline VI vShiftRight(VI a, int n) { return _mm_srli_epi32(a, n); }
+static inline VI vShiftRightSigned(VI a, int n) { return _mm_srai_epi32(a, n); }
+static inline VF vFloat(VI a) { return _mm_cvtepi32_ps(a); }
+static inline VI vTruncate(VF a) { return _mm_cvttps_epi32(a); }
+static inline VF vAddF(VF a, VF b) { return _mm_add_ps(a, b); }
+static inline VF vMulF(VF a, VF b) { return _mm_mul_ps(a, b); }
+static inline VF vDivF(VF a, VF b) { return _mm_div_ps(a, b); }
+static inline VF vSqrtF(VF a) { return _mm_sqrt_ps(a); }
+
+static inline VI vGather(const int32_t *table, VI index) {
+    return _mm_setr_epi32(table[_mm_extract_epi32(index, 0)], table[_mm_extract_epi32(index, 1)],
+                          table[_mm_extract_epi32(index, 2)], table[_mm_extract_epi32(index, 3)]);
+}
+
+static inline void vStore(int16_t *p, VI v) {
+    _mm_storel_epi64((__m128i *)p, _mm_packs_epi32(v, v));
+}
+
+static inline void vStoreUnsigned(uint16_t *p, VI v) {
+    _mm_storel_epi64((__m128i *)p, _mm_packus_epi32(v, v));
+}
+
+// (a * b + 2^31) >> 32 of unsigned lanes, the multiply works on the even lanes only.
+static inline VI vMulRound(VI a, VI b) {
+    const __m128i half = _mm_set1_epi64x(1LL << 31);
+    __m128i even = _mm_add_epi64(_mm_mul_epu32(a, b), half);
+    __m128i odd = _mm_add_epi64(_mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32)), half);
+    return _mm_blend_epi16(_mm_srli_epi64(even, 32), odd, 0xCC);
+}
+#endif
+
+// Unsigned a > b, the lanes are compared as signed after flipping their top bit.
+static inline VI vGtUnsigned(VI a, VI b) {
+    const VI top = vSet(INT32_MIN);
+    return vGt(vXor(a, top), vXor(b, top));
+}
+
+/**
+	The atan table of the compass with 32 bit entries, for the gather.
+**/
+struct QMC5883LAtanTable {
+    int32_t value[33];
+
+    QMC5883LAtanTable() {
+        for ( byte i = 0; i < 33; i++ ) value[i] = pgm_read_word(&QMC5883L_ATAN[i]);
+    }
+};
+
+#endif
+
+/**
+	CALIBRATE
+	Apply the calibration of a compass, the same as its @see read() does, including the
+	temperature compensation at its current temperature. Smoothing is not applied. The output
+	may be the same arrays as the input.
+
+	@since v1.3.0
+	@param compass the compass whose calibration is used
+	@param count number of samples in every array
+**/
+void QMC5883LBatch::calibrate(QMC5883LCompass *compass, const int16_t *x, const int16_t *y, const int16_t *z,
+                              int16_t *calibratedX, int16_t *calibratedY, int16_t *calibratedZ, size_t count){
+    const int16_t *in[3] = {x, y, z};
+    int16_t *out[3] = {calibratedX, calibratedY, calibratedZ};
+
+    for ( byte axis = 0; axis < 3; axis++ ) {
+        size_t i = 0;
+#ifdef QMC5883L_BATCH_SIMD
+        // |delta| * |scale| rounded, with the sign put back afterwards, like _calibrated().
+        int32_t scale = compass->_scaleQ24[axis];
+        const VI offset = vSet(compass->_offsetQ8[axis]);
+        const VI scaleSize = vSet(scale < 0 ? -scale : scale);
+        const VI scaleSign = vSet(scale < 0 ? -1 : 0);
+        for ( ; i + LANES <= count; i += LANES ) {
+            VI delta = vSub(vShiftLeft(vLoad(in[axis] + i), 8), offset);
+            VI sign = vXor(vShiftRightSigned(delta, 31), scaleSign);
+            VI size = vMulRound(vAbs(delta), scaleSize);
+            vStore(out[axis] + i, vSub(vXor(size, sign), sign));
+        }
+#endif
+        for ( ; i < count; i++ ) {
+            out[axis][i] = compass->_calibrated(axis, in[axis][i]);
+        }
+    }
+}
+
+/**
+	STRENGTH
+	Length of the field, sqrt(x^2 + y^2 + z^2) rounded down, the same as
+	@see QMC5883LCompass::getFieldStrength().
+
+	@since v1.3.0
+	@param count number of samples in every array
+**/
+void QMC5883LBatch::strength(const int16_t *x, const int16_t *y, const int16_t *z, uint16_t *strength, size_t count){
+    size_t i = 0;
+#ifdef QMC5883L_BATCH_SIMD
+    const VI one = vSet(1);
+    for ( ; i + LANES <= count; i += LANES ) {
+        VI vx = vLoad(x + i);
+        VI vy = vLoad(y + i);
+        VI vz = vLoad(z + i);
+        // Exact sum of squares, up to 3 * 2^30 so it is compared as unsigned.
+        VI square = vAdd(vAdd(vMul(vx, vx), vMul(vy, vy)), vMul(vz, vz));
+
+        // A float square root is at most 1 off, correct it in both directions.
+        VF fx = vFloat(vx);
+        VF fy = vFloat(vy);
+        VF fz = vFloat(vz);
+        VI root = vTruncate(vSqrtF(vAddF(vAddF(vMulF(fx, fx), vMulF(fy, fy)), vMulF(fz, fz))));
+        root = vAdd(root, vGtUnsigned(vMul(root, root), square));
+        VI next = vAdd(root, one);
+        root = vAdd(next, vGtUnsigned(vMul(next, next), square));
+        vStoreUnsigned(strength + i, root);
+    }
+#endif
+    for ( ; i < count; i++ ) {
+        long vx = x[i];
+        long vy = y[i];
+        long vz = z[i];
+        strength[i] = (uint16_t)QMC5883LCompass::_sqrt((unsigned long)(vx * vx) + (unsigned long)(vy * vy) + (unsigned long)(vz * vz));
+    }
+}
+
+/**
+	AZIMUTH
+	Azimuth of calibrated X / Y values in hundredths of a degree, corrected with the magnetic
+	declination and deviation table of a compass, the same as
+	@see QMC5883LCompass::getAzimuthCentidegrees() but without holding the heading during a
+	disturbance. With a deviation table, or with QMC5883L_FLOAT_AZIMUTH defined, the samples
+	are done one at a time.
+
+	@since v1.3.0
+	@param compass the compass whose declination and deviation are used
+	@param azimuth receives 0 - 35999 per sample
+	@param count number of samples in every array
+**/
+void QMC5883LBatch::azimuth(QMC5883LCompass *compass, const int16_t *x, const int16_t *y, uint16_t *azimuth, size_t count){
+    size_t i = 0;
+#if defined(QMC5883L_BATCH_SIMD) && !defined(QMC5883L_FLOAT_AZIMUTH)
+    static const QMC5883LAtanTable table;
+    const VI zero = vSet(0);
+    const VI one = vSet(1);
+    const VI full = vSet(36000);
+    const VI declination = vSet(compass->_magneticDeclination);
+
+    // The same steps as QMC5883LCompass::_atan2().
+    for ( ; !compass->_deviationUse && i + LANES <= count; i += LANES ) {
+        VI vx = vLoad(x + i);
+        VI vy = vLoad(y + i);
+        VI ax = vAbs(vx);
+        VI ay = vAbs(vy);
+        VI large = vGt(vMax(ax, ay), vSet(32767));
+        ax = vBlend(ax, vShiftRight(ax, 1), large);
+        ay = vBlend(ay, vShiftRight(ay, 1), large);
+
+        // ratio = (smaller << 15) / larger, a float estimate corrected with the remainder.
+        VI steep = vGt(ay, ax);
+        VI dividend = vShiftLeft(vMin(ax, ay), 15);
+        VI divisor = vMax(vMax(ax, ay), one);
+        VI ratio = vTruncate(vDivF(vFloat(dividend), vFloat(divisor)));
+        VI remainder = vSub(dividend, vMul(ratio, divisor));
+        VI under = vGt(zero, remainder);
+        ratio = vAdd(ratio, under);
+        remainder = vAdd(remainder, vAnd(divisor, under));
+        ratio = vAdd(vAdd(ratio, one), vGt(divisor, remainder));
+
+        VI index = vShiftRight(ratio, 10);
+        VI fraction = vAnd(ratio, vSet(1023));
+        VI angle = vGather(table.value, index);
+        VI next = vGather(table.value, vMin(vAdd(index, one), vSet(32)));
+        angle = vAdd(angle, vShiftRightSigned(vMul(vSub(next, angle), fraction), 10));
+        // (angle + 5) / 10, exact up to 45005.
+        angle = vShiftRight(vMul(vAdd(angle, vSet(5)), vSet(52429)), 19);
+
+        angle = vBlend(angle, vSub(vSet(9000), angle), steep);
+        angle = vBlend(angle, vSub(vSet(18000), angle), vGt(zero, vx));
+        angle = vBlend(angle, vSub(zero, angle), vGt(zero, vy));
+
+        VI heading = vAdd(angle, declination);
+        heading = vAdd(heading, vAnd(full, vGt(zero, heading)));
+        heading = vSub(heading, vAnd(full, vGt(heading, vSet(35999))));
+        vStoreUnsigned(azimuth + i, heading);
+    }
+#endif
+    for ( ; i < count; i++ ) {
+        long heading = compass->_correctHeading(QMC5883LCompass::_angle(y[i], x[i])) % 36000;
+        if ( heading < 0 ) heading += 36000;
+        azimuth[i] = (uint16_t)heading;
+    }
+}
+
+/**
+	GET INSTRUCTION SET
+	Which instructions the library was built for.
+
+	@since v1.3.0
+	@return const char* "AVX2", "SSE4.1" or "scalar"
+**/
+const char *QMC5883LBatch::getInstructionSet(){
+#ifdef QMC5883L_BATCH_SIMD
+    return QMC5883L_BATCH_SIMD;
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,35 @@
+#ifndef QMC5883L_Batch
+#define QMC5883L_Batch
+
+#include "QMC5883LPlatform.h"
+#include "QMC5883LCompass.h"
+
+/**
+	BATCH PROCESSING
+	The per sample math of the compass for many samples at once, e.g. to process recorded logs
+	on a PC or server. The samples are passed as separate arrays for X, Y and Z (structure of
+	arrays). Built for x86 with AVX2 (-mavx2 or -march=native) or SSE4.1 (-msse4.1), 8 or 4
+	samples are done per instruction, on other platforms one at a time. Every function gives
+	exactly the same results as the compass itself, @see getInstructionSet().
+
+	Example:
+
+	int16_t x[1000], y[1000], z[1000];
+	uint16_t azimuth[1000];
+
+	QMC5883LBatch::calibrate(&compass, x, y, z, x, y, z, 1000);
+	QMC5883LBatch::azimuth(&compass, x, y, azimuth, 1000);
+
+	@since v1.3.0
+**/
+class QMC5883LBatch{
+
+public:
+    static void calibrate(QMC5883LCompass *compass, const int16_t *x, const int16_t *y, const int16_t *z,
+                          int16_t *calibratedX, int16_t *calibratedY, int16_t *calibratedZ, size_t count);
+    static void strength(const int16_t *x, const int16_t *y, const int16_t *z, uint16_t *strength, size_t count);
+    static void azimuth(QMC5883LCompass *compass, const int16_t *x, const int16_t *y, uint16_t *azimuth, size_t count);
+    static const char *getInstructionSet();
+};
+
+#endif
@@ -52,11 +52,50 @@ OVER SAMPLE RATIO (OSR)
 
 
 
-#include "Arduino.h"
 #include "QMC5883LCompass.h"
-#include <Wire.h>
-
-QMC5883LCompass::QMC5883LCompass() {
+#include "QMC5883LDeclination.h"
+#include "QMC5883LMux.h"
+
+// sin() of 0 - 90 degrees in 5 degree steps, scaled by 32767.
+static const int16_t QMC5883L_SINE[19] PROGMEM = {
+    0, 2856, 5690, 8481, 11207, 13848, 16383, 18794, 21062, 23170,
+    25101, 26841, 28377, 29697, 30791, 31650, 32269, 32642, 32767
+};
+
+// atan() of 0 - 1 in 1/32 steps, in thousandths of a degree, shared with QMC5883LBatch.
+const uint16_t QMC5883L_ATAN[33] PROGMEM = {
+    0, 1790, 3576, 5356, 7125, 8881, 10620, 12339, 14036, 15709, 17354,
+    18970, 20556, 22109, 23629, 25115, 26565, 27979, 29358, 30700, 32005, 33275,
+    34509, 35707, 36870, 37999, 39094, 40156, 41186, 42184, 43152, 44091, 45000
+};
+
+// tan() of 5.625 - 39.375 degrees in 5.625 degree steps (the sector edges of a 32 point
+// compass rose within one octant), scaled by 32768.
+static const uint16_t QMC5883L_TAN[7] PROGMEM = {
+    3227, 6518, 9940, 13573, 17515, 21895, 26892
+};
+
+const char QMC5883L_DIRECTIONS[32][4] PROGMEM = {
+    {' ', ' ', ' ', 'N'}, {' ', 'N', 'b', 'E'}, {' ', 'N', 'N', 'E'}, {'N', 'E', 'b', 'N'},
+    {' ', ' ', 'N', 'E'}, {'N', 'E', 'b', 'E'}, {' ', 'E', 'N', 'E'}, {' ', 'E', 'b', 'N'},
+    {' ', ' ', ' ', 'E'}, {' ', 'E', 'b', 'S'}, {' ', 'E', 'S', 'E'}, {'S', 'E', 'b', 'E'},
+    {' ', ' ', 'S', 'E'}, {'S', 'E', 'b', 'S'}, {' ', 'S', 'S', 'E'}, {' ', 'S', 'b', 'E'},
+    {' ', ' ', ' ', 'S'}, {' ', 'S', 'b', 'W'}, {' ', 'S', 'S', 'W'}, {'S', 'W', 'b', 'S'},
+    {' ', ' ', 'S', 'W'}, {'S', 'W', 'b', 'W'}, {' ', 'W', 'S', 'W'}, {' ', 'W', 'b', 'S'},
+    {' ', ' ', ' ', 'W'}, {' ', 'W', 'b', 'N'}, {' ', 'W', 'N', 'W'}, {'N', 'W', 'b', 'W'},
+    {' ', ' ', 'N', 'W'}, {'N', 'W', 'b', 'N'}, {' ', 'N', 'N', 'W'}, {' ', 'N', 'b', 'W'},
+};
+
+QMC5883LCompass::QMC5883LCompass()
+    : _autoCalibrate(false),
+      _smoothUse(false),
+      _smoothAdvanced(false),
+      _deviationUse(false),
+      _headingCached(false),
+      _disturbanceCached(false),
+      _disturbed(false),
+      _holdHeading(false),
+      _fitTracking(false) {
 }
 
 void QMC5883LCompass::setAutocalibrate(bool autoCalibrateEnabled) {
@@ -98,6 +137,38 @@ void QMC5883LCompass::setADDR(byte b){
     _ADDR = b;
 }
 
+/**
+	SET MULTIPLEXER
+	Reach the chip through a channel of a TCA9548A I2C multiplexer, @see QMC5883LMux. The
+	channel is selected before talking to the chip, which costs nothing when it is selected
+	already. Call this before init(), with the multiplexer initialized on the same bus.
+	
+	Example:
+	
+	mux.init();
+	compass.setMultiplexer(&mux, 3);
+	compass.init();
+	
+	@since v1.3.0
+	@param mux the multiplexer, or nullptr for a chip directly on the bus
+	@param channel 0 - 7
+**/
+void QMC5883LCompass::setMultiplexer(QMC5883LMux *mux, byte channel){
+    _mux = mux;
+    _muxChannel = channel;
+}
+
+/**
+	SELECT
+	Select the multiplexer channel of the chip, if it is behind one.
+	
+	@since v1.3.0
+	@return bool false if the multiplexer did not answer
+**/
+bool QMC5883LCompass::_select(){
+    return !_mux || _mux->select(_muxChannel);
+}
+
 
 
 
@@ -109,6 +180,8 @@ void QMC5883LCompass::setADDR(byte b){
 **/
 // Write register values to chip
 void QMC5883LCompass::_writeReg(byte r, byte v){
+    QMC5883LLock lock(wire);
+    if ( !_select() ) return;
     wire->beginTransmission(_ADDR);
     wire->write(r);
     wire->write(v);
@@ -124,7 +197,8 @@ void QMC5883LCompass::_writeReg(byte r, byte v){
 **/
 // Set chip mode
 void QMC5883LCompass::setMode(byte mode, byte odr, byte rng, byte osr){
-    _writeReg(0x09,mode|odr|rng|osr);
+    _control = mode|odr|rng|osr;
+    _writeReg(0x09,_control);
 }
 
 
@@ -139,7 +213,52 @@ void QMC5883LCompass::setMode(byte mode, byte odr, byte rng, byte osr){
  * then: setMagneticDeclination(-19, 43);
  */
 void QMC5883LCompass::setMagneticDeclination(int degrees, uint8_t minutes) {
-    _magneticDeclinationDegrees = (float)degrees + (float)minutes / 60;
+    _setDeclination((float)degrees + (float)minutes / 60);
+}
+
+/**
+	SET MAGNETIC DECLINATION FROM LOCATION
+	Calculate the magnetic declination for a location and date with the built-in World
+	Magnetic Model, @see QMC5883LDeclination. The result is kept until the declination is set
+	again, so call this once at startup, or again when the location has changed by a degree or
+	so. It takes a few thousand float operations.
+	
+	@example
+	For: Londrina, PR, Brazil in the middle of 2026
+	
+	then: setMagneticDeclination(-23.31, -51.16, 2026.5);
+	
+	@since v1.3.0
+	@param latitude in degrees, North positive
+	@param longitude in degrees, East positive
+	@param year decimal year, the model is valid from 2025.0 to 2030.0 @see QMC5883LDeclination::isValid()
+**/
+void QMC5883LCompass::setMagneticDeclination(float latitude, float longitude, float year) {
+    _setDeclination(QMC5883LDeclination::getDeclination(latitude, longitude, year));
+}
+
+/**
+	GET MAGNETIC DECLINATION
+	
+	@since v1.3.0
+	@return float declination in degrees, East positive
+**/
+float QMC5883LCompass::getMagneticDeclination() {
+    return _magneticDeclination / 100.;
+}
+
+/**
+	SET DECLINATION
+	Store the declination in hundredths of a degree, with the sine and cosine used by
+	@see getBearing().
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_setDeclination(float degrees) {
+    _magneticDeclination = (int)round(degrees * 100);
+    _declinationSin = _sin(_magneticDeclination);
+    _declinationCos = _sin(_magneticDeclination + 9000L);
+    _invalidateCache();
 }
 
 
@@ -159,6 +278,7 @@ void QMC5883LCompass::setSmoothing(byte steps, bool adv){
     _smoothUse = true;
     _smoothSteps = ( steps > 10) ? 10 : steps;
     _smoothAdvanced = (adv == true) ? true : false;
+    _invalidateCache();
 }
 
 void QMC5883LCompass::calibrate(unsigned int seconds, void (*callback)(float, bool)) {
@@ -170,6 +290,17 @@ void QMC5883LCompass::calibrate(unsigned int seconds, void (*callback)(float, bo
     minX = maxX = getX();
     minY = maxY = getY();
     minZ = maxZ = getZ();
+    _coverageMap = 0;
+
+    float fitOffset[3];
+    float fitScale[3];
+    _calibrationFromRange(minX, maxX, minY, maxY, minZ, maxZ, fitOffset, fitScale);
+    _resetFitStats();
+
+    // The statistics below are for the fit being collected, read() must not add the identity
+    // corrected samples to them as well.
+    bool fitTracking = _fitTracking;
+    _fitTracking = false;
 
     if(seconds == 0) seconds = 10000;
 
@@ -220,10 +351,34 @@ void QMC5883LCompass::calibrate(unsigned int seconds, void (*callback)(float, bo
             foundNewValue = true;
         }
 
+        _updateCoverage(x, y, z);
+
+        // Residuals are only meaningful for samples corrected with the same fit, so start over
+        // whenever the range grows. The final fit is the last one used here.
+        if(foundNewValue) {
+            _calibrationFromRange(minX, maxX, minY, maxY, minZ, maxZ, fitOffset, fitScale);
+            _resetFitStats();
+        }
+        _updateFitStats(
+                (x - fitOffset[0]) * fitScale[0],
+                (y - fitOffset[1]) * fitScale[1],
+                (z - fitOffset[2]) * fitScale[2]
+        );
+
         callback(progress, foundNewValue);
-    } while(elapsedMillis < totalMillis);
+    } while(elapsedMillis < totalMillis && !_calibrationTargetsMet());
 
+    unsigned long fitCount = _fitCount;
+    float fitMean = _fitMean;
+    float fitM2 = _fitM2;
     setCalibration(minX,maxX, minY, maxY, minZ, maxZ);
+    _fitCount = fitCount;
+    _fitMean = fitMean;
+    _fitM2 = fitM2;
+    _fitTracking = fitTracking;
+    if ( fitCount > 0 ) {
+        _referenceStrength = (uint16_t)round(fitMean);
+    }
 
     callback(1, false);
 }
@@ -258,6 +413,8 @@ bool QMC5883LCompass::_applyCalibrationIfNecessary(int x, int y, int z) {
         foundNewValue = true;
     }
 
+    _updateCoverage(x, y, z);
+
     if(foundNewValue) {
         setCalibration(minX,maxX, minY, maxY, minZ, maxZ);
     }
@@ -265,6 +422,327 @@ bool QMC5883LCompass::_applyCalibrationIfNecessary(int x, int y, int z) {
     return foundNewValue;
 }
 
+/**
+	IS DATA READY
+	Whether the chip has measured a new sample since the last read(), from the DRDY bit of its
+	status register. Polling this before read() gives every sample exactly once, at the data
+	rate set with setMode().
+	
+	@since v1.3.0
+	@return bool true if a new sample is ready, false if not or the chip did not answer
+**/
+bool QMC5883LCompass::isDataReady(){
+    QMC5883LLock lock(wire);
+    if ( !_select() ) return false;
+    wire->beginTransmission(_ADDR);
+    wire->write(0x06);
+    if ( wire->endTransmission(false) != 0 || wire->requestFrom(_ADDR, (byte)1) != 1 ) return false;
+    _status = wire->read();
+    return _status & 0x01;
+}
+
+/**
+	GET READ ERRORS
+	Number of failed reads in a row, e.g. because the chip is disconnected. It is 0 after a
+	successful read() and stops counting at 255.
+	
+	@since v1.3.0
+	@return byte failed reads since the last successful one
+**/
+byte QMC5883LCompass::getReadErrors(){
+    return _readErrors;
+}
+
+/**
+	GET SEQUENCE
+	Number of samples read so far. It goes up by one with every successful @see read() and
+	wraps around at 65535, so compare it for equality to find out whether there is a new sample.
+	
+	@since v1.3.0
+	@return uint16_t sample sequence number
+**/
+uint16_t QMC5883LCompass::getSequence(){
+    return _sequence;
+}
+
+/**
+	GET SAMPLE
+	Copy the latest sample at once, for reading it in another thread or RTOS task than the one
+	calling @see read(). Separate getX(), getY() and getZ() calls could each see a different
+	sample, and getAzimuth() and friends share a cache that is not safe to use from two threads.
+	
+	The copy is checked against a counter that read() changes before and after each sample
+	(a seqlock), and taken again when a read() came in between, so the reader never blocks
+	read(). If that keeps happening, it waits for read() on the bus lock. Settings such as the
+	calibration are not protected, change them before the threads start or while holding
+	@see QMC5883LLock.
+	
+	The azimuth is calculated like @see getAzimuthCentidegrees(), but without holding the
+	heading during a disturbance.
+	
+	Example:
+	
+	QMC5883LSample sample;
+	compass.getSample(&sample);
+	Serial.println(sample.azimuth / 100);
+	
+	@since v1.3.0
+	@param sample receives the sample
+**/
+void QMC5883LCompass::getSample(QMC5883LSample *sample){
+    bool consistent = false;
+    for ( byte attempt = 0; attempt < 4 && !consistent; attempt++ ) {
+        uint16_t begin = _seqlock;
+        QMC5883L_BARRIER();
+        _copySample(sample);
+        QMC5883L_BARRIER();
+        consistent = !(begin & 1) && _seqlock == begin;
+    }
+    if ( !consistent ) {
+        QMC5883LLock lock(wire);
+        _copySample(sample);
+    }
+
+    long heading = _correctHeading(_angle(sample->y, sample->x)) % 36000;
+    if ( heading < 0 ) heading += 36000;
+    sample->azimuth = (uint16_t)heading;
+}
+
+/**
+	COPY SAMPLE
+	@see getSample()
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_copySample(QMC5883LSample *sample){
+    sample->x = (int16_t)_get(0);
+    sample->y = (int16_t)_get(1);
+    sample->z = (int16_t)_get(2);
+    sample->temperature = (int16_t)getTemperature();
+    sample->sequence = _sequence;
+    sample->readErrors = _readErrors;
+}
+
+/**
+	INVALIDATE CACHE
+	Forget the azimuth and bearing calculated for the current sample. Called by @see read() and
+	by every setting that changes them.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_invalidateCache(){
+    _headingCached = false;
+    _disturbanceCached = false;
+    _cachedSectorPoints = 0;
+}
+
+/**
+	SET CALIBRATION TARGETS
+	Allow calibrate() to finish before its time limit once the sensor has been rotated through
+	enough orientations and the fit is good enough.
+
+	@param coverage percentage (0 - 100) of the 24 sphere bins that must have been visited, 0 disables
+	@param quality minimum value (0 - 100) @see getCalibrationQuality() must report
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setCalibrationTargets(byte coverage, byte quality) {
+    _coverageTarget = ( coverage > 100 ) ? 100 : coverage;
+    _qualityTarget = ( quality > 100 ) ? 100 : quality;
+}
+
+/**
+	GET CALIBRATION COVERAGE
+	Percentage of the sphere that has been visited during calibration.
+	
+	@since v1.3.0
+	@return byte coverage 0 - 100
+**/
+byte QMC5883LCompass::getCalibrationCoverage() {
+    byte visited = 0;
+    for ( uint32_t map = _coverageMap; map; map &= map - 1 ) {
+        visited++;
+    }
+    return (byte)((visited * 100) / 24);
+}
+
+/**
+	GET CALIBRATION COVERAGE MAP
+	The sphere is split into 24 bins: 6 cube faces (the dominant axis and its sign) with 4 quadrants
+	each (the signs of the two remaining axes). Bit (face * 4 + quadrant) is set once a sample has
+	fallen into that bin, where face is 0 = +X, 1 = -X, 2 = +Y, 3 = -Y, 4 = +Z, 5 = -Z and quadrant
+	bit 0 / bit 1 are set when the first / second remaining axis (in X, Y, Z order) is negative.
+	A cleared bit tells you which orientation is still missing.
+	
+	@since v1.3.0
+	@return uint32_t bitmask of visited bins
+**/
+uint32_t QMC5883LCompass::getCalibrationCoverageMap() {
+    return _coverageMap;
+}
+
+/**
+	GET CALIBRATION QUALITY
+	Overall 0 - 100 score of the calibration. It is the lowest of three partial scores:
+	
+	- Coverage, @see getCalibrationCoverage().
+	- Range balance. A well rotated sensor sees roughly the same range on every axis, so this is
+	  the smallest axis range as a percentage of the largest one.
+	- Residual. 100 minus 10 points per percent of @see getCalibrationResidual(), so a corrected
+	  field that wanders by 10% or more scores 0.
+	
+	Coverage and range come from calibrate() or auto calibration. Residuals are collected by
+	calibrate(), and by every read() after @see setCalibrationTracking(), and restart whenever the
+	calibration changes.
+	
+	@since v1.3.0
+	@return byte quality 0 - 100
+**/
+byte QMC5883LCompass::getCalibrationQuality() {
+    if ( !hasCalibrationQuality() ) return 0;
+    long spanX = (long)maxX - minX;
+    long spanY = (long)maxY - minY;
+    long spanZ = (long)maxZ - minZ;
+    long spanMin = spanX;
+    long spanMax = spanX;
+    if ( spanY < spanMin ) spanMin = spanY;
+    if ( spanZ < spanMin ) spanMin = spanZ;
+    if ( spanY > spanMax ) spanMax = spanY;
+    if ( spanZ > spanMax ) spanMax = spanZ;
+
+    byte quality = getCalibrationCoverage();
+    byte balance = (byte)((spanMin * 100) / spanMax);
+    if ( balance < quality ) quality = balance;
+
+    float residual = 100. - getCalibrationResidual() * 10.;
+    if ( residual < quality ) quality = ( residual > 0 ) ? (byte)residual : 0;
+
+    return quality;
+}
+
+/**
+	HAS CALIBRATION QUALITY
+	Whether @see getCalibrationQuality() has anything to score: a range on every axis from
+	calibrate() or auto calibration, and field strength statistics for the current calibration.
+	Without them the quality is 0 as well, this tells a missing score apart from a bad one.
+	
+	@since v1.3.0
+	@return bool true when the quality is a real score
+**/
+bool QMC5883LCompass::hasCalibrationQuality() {
+    return maxX > minX && maxY > minY && maxZ > minZ && _fitCount >= 2;
+}
+
+/**
+	GET CALIBRATION RESIDUAL
+	After a good calibration the corrected field has the same strength in every orientation.
+	This returns the RMS deviation of the corrected field strength from its mean, as a
+	percentage of the mean.
+	
+	@since v1.3.0
+	@return float residual in percent
+**/
+float QMC5883LCompass::getCalibrationResidual() {
+    if ( _fitCount < 2 || _fitMean <= 0 ) return 0;
+    return sqrt(getCalibrationFieldVariance()) * 100. / _fitMean;
+}
+
+/**
+	GET CALIBRATION FIELD VARIANCE
+	Variance of the corrected field strength since the calibration last changed.
+	
+	@since v1.3.0
+	@return float variance in sensor units squared
+**/
+float QMC5883LCompass::getCalibrationFieldVariance() {
+    if ( _fitCount < 2 ) return 0;
+    return _fitM2 / (float)(_fitCount - 1);
+}
+
+/**
+	SET CALIBRATION TRACKING
+	Add every read() to the field strength statistics behind @see getCalibrationResidual(), to
+	keep checking a calibration that was set with setCalibrationOffsets() / setCalibrationScales()
+	or one that auto calibration keeps changing. Off by default, as it costs a square root and a
+	division per read, which is slow on 8 bit boards. calibrate() collects its own statistics
+	either way.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setCalibrationTracking(bool enabled) {
+    _fitTracking = enabled;
+}
+
+/**
+	UPDATE COVERAGE
+	Mark the sphere bin the current sample points to, relative to the centre of the
+	min / max values collected so far.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_updateCoverage(int x, int y, int z) {
+    long v[3] = {
+        (long)x - ((long)minX + maxX) / 2,
+        (long)y - ((long)minY + maxY) / 2,
+        (long)z - ((long)minZ + maxZ) / 2
+    };
+    long a[3] = { labs(v[0]), labs(v[1]), labs(v[2]) };
+
+    byte axis = ( a[0] >= a[1] ) ? 0 : 1;
+    if ( a[2] > a[axis] ) axis = 2;
+    if ( a[axis] == 0 ) return;
+
+    byte face = axis * 2 + ( v[axis] < 0 ? 1 : 0 );
+    byte quadrant = 0;
+    byte bit = 0;
+    for ( byte i = 0; i < 3; i++ ) {
+        if ( i == axis ) continue;
+        if ( v[i] < 0 ) quadrant |= 1 << bit;
+        bit++;
+    }
+
+    _coverageMap |= (uint32_t)1 << (face * 4 + quadrant);
+}
+
+/**
+	CALIBRATION TARGETS MET
+	@see setCalibrationTargets()
+	
+	@since v1.3.0
+	@return bool true when a coverage target is set and both targets have been reached
+**/
+bool QMC5883LCompass::_calibrationTargetsMet() {
+    if ( _coverageTarget == 0 ) return false;
+    return getCalibrationCoverage() >= _coverageTarget && getCalibrationQuality() >= _qualityTarget;
+}
+
+/**
+	RESET FIT STATISTICS
+	Forget the field strength statistics collected for the previous calibration.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_resetFitStats() {
+    _fitCount = 0;
+    _fitMean = 0;
+    _fitM2 = 0;
+}
+
+/**
+	UPDATE FIT STATISTICS
+	Add a corrected sample to the running mean and variance of the field strength
+	(Welford's online algorithm, so no samples need to be kept).
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_updateFitStats(float x, float y, float z) {
+    float magnitude = sqrt(x * x + y * y + z * z);
+    _fitCount++;
+    float delta = magnitude - _fitMean;
+    _fitMean += delta / (float)_fitCount;
+    _fitM2 += delta * (magnitude - _fitMean);
+}
+
 /**
     SET CALIBRATION
 	Set calibration values for more accurate readings
@@ -276,6 +754,20 @@ bool QMC5883LCompass::_applyCalibrationIfNecessary(int x, int y, int z) {
 	@deprecated Instead of setCalibration, use the calibration offset and scale methods.
 **/
 void QMC5883LCompass::setCalibration(int x_min, int x_max, int y_min, int y_max, int z_min, int z_max){
+    float offset[3];
+    float scale[3];
+    _calibrationFromRange(x_min, x_max, y_min, y_max, z_min, z_max, offset, scale);
+    setCalibrationOffsets(offset[0], offset[1], offset[2]);
+    setCalibrationScales(scale[0], scale[1], scale[2]);
+}
+
+/**
+	CALIBRATION FROM RANGE
+	Turn min / max values into hard iron offsets and soft iron scales.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_calibrationFromRange(int x_min, int x_max, int y_min, int y_max, int z_min, int z_max, float *offset, float *scale){
     float x_min_f = x_min;
     float x_max_f = x_max;
     float y_min_f = y_min;
@@ -283,11 +775,9 @@ void QMC5883LCompass::setCalibration(int x_min, int x_max, int y_min, int y_max,
     float z_min_f = z_min;
     float z_max_f = z_max;
 
-    setCalibrationOffsets(
-            (x_min_f + x_max_f)/2,
-            (y_min_f + y_max_f)/2,
-            (z_min_f * z_max_f)/2
-    );
+    offset[0] = (x_min_f + x_max_f)/2;
+    offset[1] = (y_min_f + y_max_f)/2;
+    offset[2] = (z_min_f + z_max_f)/2;
 
     float x_avg_delta = (x_max_f - x_min_f)/2;
     float y_avg_delta = (y_max_f - y_min_f)/2;
@@ -295,23 +785,25 @@ void QMC5883LCompass::setCalibration(int x_min, int x_max, int y_min, int y_max,
 
     float avg_delta = (x_avg_delta + y_avg_delta + z_avg_delta) / 3;
 
-    setCalibrationScales(
-            avg_delta / x_avg_delta,
-            avg_delta / y_avg_delta,
-            avg_delta / z_avg_delta
-    );
+    scale[0] = avg_delta / x_avg_delta;
+    scale[1] = avg_delta / y_avg_delta;
+    scale[2] = avg_delta / z_avg_delta;
 }
 
 void QMC5883LCompass::setCalibrationOffsets(float x_offset, float y_offset, float z_offset) {
     _offset[0] = x_offset;
     _offset[1] = y_offset;
     _offset[2] = z_offset;
+    _updateCalibrationCoefficients();
+    _resetFitStats();
 }
 
 void QMC5883LCompass::setCalibrationScales(float x_scale, float y_scale, float z_scale) {
     _scale[0] = x_scale;
     _scale[1] = y_scale;
     _scale[2] = z_scale;
+    _updateCalibrationCoefficients();
+    _resetFitStats();
 }
 
 float QMC5883LCompass::getCalibrationOffset(uint8_t index) {
@@ -327,60 +819,344 @@ void QMC5883LCompass::clearCalibration(){
     setCalibrationScales(1., 1., 1.);
 }
 
+/**
+	ENABLE TEMPERATURE
+	Read the on-chip thermometer along with every XYZ reading. This adds 3 bytes to every read
+	and is switched on automatically by @see setTemperatureCompensation().
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::enableTemperature(bool enabled){
+    _readTemperature = enabled || _temperatureTableSize > 0;
+}
+
+/**
+	SET TEMPERATURE OFFSET
+	The thermometer has an accurate slope of 100 LSB per degree but an uncalibrated offset.
+	Set the offset, in hundredths of a degree, that makes @see getTemperature() read the right
+	absolute temperature. Compensation tables use the corrected value as well.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setTemperatureOffset(int offset){
+    _temperatureOffset = offset;
+    if ( _temperatureTableSize > 0 ) {
+        _updateCalibrationCoefficients();
+    }
+}
+
+/**
+	GET TEMPERATURE
+	Temperature of the last read(), @see enableTemperature().
+	
+	@since v1.3.0
+	@return int temperature in hundredths of a degree Celsius
+**/
+int QMC5883LCompass::getTemperature(){
+    return _temperature + _temperatureOffset;
+}
+
+/**
+	SET TEMPERATURE COMPENSATION
+	Correct offset and scale drift over temperature. The table holds the change of the
+	calibration at a number of temperatures, relative to the temperature the sensor was
+	calibrated at, and must be sorted by ascending temperature (as returned by
+	@see getTemperature()). Between two points the correction is interpolated linearly,
+	outside the table the nearest point is used.
+	
+	The table is not copied, so it must stay valid while in use. Pass nullptr to switch
+	compensation off.
+	
+	Example:
+	
+	QMC5883LTemperaturePoint table[] = {
+	    {-2000, {-35., 12., 4.}, {1.02, 1.01, 1.}},
+	    { 2500, {  0.,  0., 0.}, {1.,   1.,   1.}},
+	    { 6000, { 28., -9., 2.}, {0.98, 0.99, 1.}},
+	};
+	compass.setTemperatureCompensation(table, 3);
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setTemperatureCompensation(const QMC5883LTemperaturePoint *table, byte count){
+    _temperatureTable = table;
+    _temperatureTableSize = table ? count : 0;
+    if ( _temperatureTableSize > 0 ) {
+        _readTemperature = true;
+    }
+    _updateCalibrationCoefficients();
+}
+
+/**
+	TEMPERATURE CORRECTION
+	Interpolate the compensation table at the current temperature.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_temperatureCorrection(float *offset, float *scale){
+    if ( _temperatureTableSize == 0 ) return;
+
+    int t = getTemperature();
+    const QMC5883LTemperaturePoint *lo = &_temperatureTable[0];
+    const QMC5883LTemperaturePoint *hi = &_temperatureTable[_temperatureTableSize - 1];
+
+    if ( t <= lo->temperature ) {
+        hi = lo;
+    } else if ( t >= hi->temperature ) {
+        lo = hi;
+    } else {
+        for ( byte i = 1; i < _temperatureTableSize; i++ ) {
+            if ( t <= _temperatureTable[i].temperature ) {
+                lo = &_temperatureTable[i - 1];
+                hi = &_temperatureTable[i];
+                break;
+            }
+        }
+    }
+
+    float f = 0;
+    if ( hi->temperature != lo->temperature ) {
+        f = (float)(t - lo->temperature) / (float)(hi->temperature - lo->temperature);
+    }
+
+    for ( int i = 0; i < 3; i++ ) {
+        offset[i] = lo->offset[i] + (hi->offset[i] - lo->offset[i]) * f;
+        scale[i] = lo->scale[i] + (hi->scale[i] - lo->scale[i]) * f;
+    }
+}
+
 /**
 	READ
 	Read the XYZ axis and save the values in an array.
+	When the chip does not answer the previous values are kept, @see getReadErrors().
+	The bus is locked for the whole read (@see QMC5883LLock.h), and readers in other threads
+	see the new sample all at once through @see getSample().
 	
+	This is @see readRaw() followed by @see process().
+	
+	@since v1.3.0 - counts failed reads, locks the bus.
 	@since v0.1;
 **/
 bool QMC5883LCompass::read(){
-    bool foundNewValue = false;
+    QMC5883LLock lock(wire);
+    QMC5883LRawSample raw;
+    if ( readRaw(&raw) ) {
+        return process(&raw);
+    }
+    _readFailed();
+    return false;
+}
+
+/**
+	READ FAILED
+	Count a failed read, @see getReadErrors().
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_readFailed(){
+    // Odd while the sample is being changed, @see getSample().
+    _seqlock = _seqlock + 1;
+    QMC5883L_BARRIER();
+    if ( _readErrors < 255 ) _readErrors++;
+    QMC5883L_BARRIER();
+    _seqlock = _seqlock + 1;
+}
+
+/**
+	READ RAW
+	Only the bus part of @see read(): fetch a sample from the chip without processing it or
+	changing the current sample. Together with @see process() this lets one thread do the bus
+	I/O while another does the math, @see QMC5883LPipeline. The two may run at the same time
+	on the same compass, but readRaw() is not for more than one thread at once.
+	
+	@since v1.3.0
+	@param raw receives the uncalibrated values, the temperature (INT16_MIN unless
+	       @see enableTemperature()), the status register (0 unless enableTemperature())
+	       and the micros() at which the read started
+	@return bool false if the chip did not answer
+**/
+bool QMC5883LCompass::readRaw(QMC5883LRawSample *raw){
+    QMC5883LLock lock(wire);
+    byte count = _readTemperature ? 9 : 6;
+    raw->timestamp = micros();
+    if ( !_select() ) return false;
+
     wire->beginTransmission(_ADDR);
     wire->write(0x00);
-    int err = wire->endTransmission();
-    if (!err) {
-        wire->requestFrom(_ADDR, (byte)6);
-        int x = (int)(int16_t)(wire->read() | wire->read() << 8);
-        int y = (int)(int16_t)(wire->read() | wire->read() << 8);
-        int z = (int)(int16_t)(wire->read() | wire->read() << 8);
-
-        if(_autoCalibrate) {
-            foundNewValue = _applyCalibrationIfNecessary(x, y, z);
-        }
+    if ( wire->endTransmission(false) != 0 || wire->requestFrom(_ADDR, count) != count ) {
+        return false;
+    }
+
+    raw->x = (int16_t)(wire->read() | wire->read() << 8);
+    raw->y = (int16_t)(wire->read() | wire->read() << 8);
+    raw->z = (int16_t)(wire->read() | wire->read() << 8);
+    raw->temperature = INT16_MIN;
+    raw->status = 0;
+    if ( count == 9 ) {
+        _status = wire->read();
+        raw->status = _status;
+        raw->temperature = (int16_t)(wire->read() | wire->read() << 8);
+    }
+    return true;
+}
 
-        _vRaw[0] = x;
-        _vRaw[1] = y;
-        _vRaw[2] = z;
+/**
+	PROCESS
+	The math part of @see read(): make a sample from @see readRaw() the current one, with
+	temperature compensation, calibration, auto calibration and smoothing.
+	
+	@since v1.3.0
+	@return bool true if auto calibration found a new minimum or maximum, like read()
+**/
+bool QMC5883LCompass::process(const QMC5883LRawSample *raw){
+    bool foundNewValue = false;
 
-        _applyCalibration();
+    // Odd while the sample is being changed, @see getSample().
+    _seqlock = _seqlock + 1;
+    QMC5883L_BARRIER();
+    _readErrors = 0;
 
-        if ( _smoothUse ) {
-            _smoothing();
+    if ( raw->temperature != INT16_MIN ) {
+        _temperature = raw->temperature;
+
+        // The coefficients only need refreshing when the temperature has moved by 0.1 degrees.
+        if(_temperatureTableSize > 0 && abs(_temperature - _compensatedTemperature) >= 10) {
+            _updateCalibrationCoefficients();
         }
+    }
+
+    if(_autoCalibrate) {
+        foundNewValue = _applyCalibrationIfNecessary(raw->x, raw->y, raw->z);
+    }
+
+    _vRaw[0] = raw->x;
+    _vRaw[1] = raw->y;
+    _vRaw[2] = raw->z;
+
+    _applyCalibration();
+    if ( _fitTracking ) {
+        _updateFitStats(_vCalibrated[0], _vCalibrated[1], _vCalibrated[2]);
+    }
 
-        //byte overflow = wire->read() & 0x02;
-        //return overflow << 2;
+    if ( _smoothUse ) {
+        _smoothing();
     }
+
+    _sequence++;
+    _invalidateCache();
+    QMC5883L_BARRIER();
+    _seqlock = _seqlock + 1;
     return foundNewValue;
 }
 
+/**
+	UPDATE CALIBRATION COEFFICIENTS
+	Convert the float offsets and scales, corrected for the current temperature, into the fixed
+	point coefficients used by @see _applyCalibration(). Offsets are stored in 1/256 units and scales in 1/2^24 units,
+	clamped so the multiply in _applyCalibration() can not overflow (|offset| < 2^22, |scale| < 128).
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::_updateCalibrationCoefficients(){
+    float offsetDelta[3] = {0., 0., 0.};
+    float scaleFactor[3] = {1., 1., 1.};
+    _temperatureCorrection(offsetDelta, scaleFactor);
+    _compensatedTemperature = _temperature;
+
+    for ( int i = 0; i < 3; i++ ) {
+        float offset = (_offset[i] + offsetDelta[i]) * 256.;
+        if ( offset > 1073741823. ) offset = 1073741823.;
+        if ( offset < -1073741823. ) offset = -1073741823.;
+        _offsetQ8[i] = (int32_t)round(offset);
+
+        float scale = _scale[i] * scaleFactor[i] * 16777216.;
+        if ( scale > 2147483520. ) scale = 2147483520.;
+        if ( scale < -2147483520. ) scale = -2147483520.;
+        _scaleQ24[i] = (int32_t)round(scale);
+    }
+}
+
 /**
     APPLY CALIBRATION
 	This function uses the calibration data provided via @see setCalibration() to calculate more
 	accurate readings
 	
+	The math is done with the fixed point coefficients from @see _updateCalibrationCoefficients():
+	a 32 bit subtract, a 32 x 32 bit multiply and a rounding shift per axis, with the same result
+	on every platform. It differs from the float calculation by at most 1, where the rounding of
+	the coefficients moves a value across a .5 tie, @see extras/linux/calibration_test.cpp.
+	
 	@author Claus Näveke - TheNitek [https://github.com/TheNitek]
 	
 	Based on this awesome article:
 	https://appelsiini.net/2018/calibrate-magnetometer/
 	
+	@since v1.3.0 - fixed point math, results are limited to the 16 bit range of the sensor.
 	@since v1.1.0
 	
 **/
 void QMC5883LCompass::_applyCalibration(){
-    _vCalibrated[0] = (int)round((_vRaw[0] - _offset[0]) * _scale[0]);
-    _vCalibrated[1] = (int)round((_vRaw[1] - _offset[1]) * _scale[1]);
-    _vCalibrated[2] = (int)round((_vRaw[2] - _offset[2]) * _scale[2]);
+    for ( int i = 0; i < 3; i++ ) {
+        _vCalibrated[i] = _calibrated(i, _vRaw[i]);
+    }
+}
+
+// 8 bit AVR has no 32 x 32 bit multiply and makes a 64 bit product a call to __muldi3, so there
+// the product is built from 16 x 16 bit multiplies. Define it to build that code elsewhere.
+#if defined(__AVR__) && !defined(QMC5883L_CALIBRATION_16BIT)
+#define QMC5883L_CALIBRATION_16BIT
+#endif
+
+/**
+	CALIBRATED
+	One axis of @see _applyCalibration().
+	
+	@since v1.3.0
+	@param axis 0 - 2 for X, Y, Z
+	@param raw uncalibrated value
+	@return int16_t calibrated value
+**/
+int16_t QMC5883LCompass::_calibrated(byte axis, int16_t raw){
+    int32_t delta = (int32_t)raw * 256 - _offsetQ8[axis];
+#ifdef QMC5883L_CALIBRATION_16BIT
+    int32_t scale = _scaleQ24[axis];
+    bool negative = ( delta < 0 ) != ( scale < 0 );
+    uint32_t d = ( delta < 0 ) ? 0 - (uint32_t)delta : (uint32_t)delta;
+    uint32_t s = ( scale < 0 ) ? 0 - (uint32_t)scale : (uint32_t)scale;
+
+    // |delta| * |scale| / 2^32 from 16 x 16 bit products. Both are below 2^31, so the result
+    // fits in 30 bits.
+    uint32_t low = (uint32_t)(uint16_t)d * (uint16_t)s;
+    uint32_t middle1 = (d >> 16) * (uint16_t)s;
+    uint32_t middle2 = (uint32_t)(uint16_t)d * (s >> 16);
+    uint32_t value = (d >> 16) * (s >> 16) + (middle1 >> 16) + (middle2 >> 16);
+
+    // Add up the low 32 bits with half of the last bit, to round half away from zero like
+    // round() does, and carry into the result.
+    uint32_t sum = low + 0x80000000UL;
+    value += ( sum < low );
+    uint32_t part = middle1 << 16;
+    sum += part;
+    value += ( sum < part );
+    part = middle2 << 16;
+    sum += part;
+    value += ( sum < part );
+
+    if ( negative ) return ( value >= 32768UL ) ? INT16_MIN : -(int16_t)value;
+    return ( value > 32767UL ) ? INT16_MAX : (int16_t)value;
+#else
+    int64_t product = (int64_t)delta * _scaleQ24[axis];
+    // Round half away from zero, like round() does.
+    int32_t value;
+    if ( product >= 0 ) {
+        value = (int32_t)((product + ((int64_t)1 << 31)) >> 32);
+    } else {
+        value = -(int32_t)((-product + ((int64_t)1 << 31)) >> 32);
+    }
+    if ( value > INT16_MAX ) value = INT16_MAX;
+    if ( value < INT16_MIN ) value = INT16_MIN;
+    return (int16_t)value;
+#endif
 }
 
 
@@ -487,27 +1263,580 @@ int QMC5883LCompass::_get(int i){
 
 
 
+/**
+	SET DEVIATION
+	Correct the heading dependent error that is left after calibration, caused by the
+	installation (a compass swing). The correction in degrees added to the heading h is
+	
+	a + b * sin(h) + c * cos(h) + d * sin(2h) + e * cos(2h)
+	
+	Use @see fitDeviation() to calculate the coefficients from reference readings.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setDeviation(float a, float b, float c, float d, float e){
+    float coefficients[5] = {a, b, c, d, e};
+    for ( int i = 0; i < 5; i++ ) {
+        float v = coefficients[i] * 100.;
+        if ( v > 32767. ) v = 32767.;
+        if ( v < -32767. ) v = -32767.;
+        _deviation[i] = (int16_t)round(v);
+    }
+    _deviationUse = true;
+    _invalidateCache();
+}
+
+/**
+	FIT DEVIATION
+	Calculate the deviation coefficients from a compass swing: point the sensor at a number of
+	known magnetic headings, spread around the circle, and record getAzimuth() for each of
+	them. Call clearDeviation() and leave the magnetic declination at 0 while recording.
+	
+	Example:
+	
+	int compassHeadings[]  = {  2, 47, 93, 139, 182, 226, 268, 313};
+	int magneticHeadings[] = {  0, 45, 90, 135, 180, 225, 270, 315};
+	compass.fitDeviation(compassHeadings, magneticHeadings, 8);
+	
+	@since v1.3.0
+	@return bool false if there are fewer than 5 readings or they do not cover enough headings,
+	        in which case the current deviation is left alone
+**/
+bool QMC5883LCompass::fitDeviation(const int *compassHeadings, const int *magneticHeadings, byte count){
+    if ( count < 5 ) return false;
+
+    // Least squares normal equations, 5 unknowns plus the right hand side.
+    float m[5][6];
+    for ( int i = 0; i < 5; i++ ) {
+        for ( int j = 0; j < 6; j++ ) m[i][j] = 0;
+    }
+
+    for ( byte k = 0; k < count; k++ ) {
+        float h = compassHeadings[k] * PI / 180.0;
+        float basis[5] = {1., sin(h), cos(h), sin(2 * h), cos(2 * h)};
+        long error = ((long)magneticHeadings[k] - compassHeadings[k]) % 360;
+        if ( error >= 180 ) error -= 360;
+        if ( error < -180 ) error += 360;
+
+        for ( int i = 0; i < 5; i++ ) {
+            for ( int j = 0; j < 5; j++ ) m[i][j] += basis[i] * basis[j];
+            m[i][5] += basis[i] * error;
+        }
+    }
+
+    // Gauss-Jordan elimination with partial pivoting.
+    for ( int col = 0; col < 5; col++ ) {
+        int pivot = col;
+        for ( int row = col + 1; row < 5; row++ ) {
+            if ( fabs(m[row][col]) > fabs(m[pivot][col]) ) pivot = row;
+        }
+        if ( fabs(m[pivot][col]) < 1e-3 * count ) return false;
+        for ( int j = 0; j < 6; j++ ) {
+            float t = m[col][j];
+            m[col][j] = m[pivot][j];
+            m[pivot][j] = t;
+        }
+        for ( int row = 0; row < 5; row++ ) {
+            if ( row == col ) continue;
+            float f = m[row][col] / m[col][col];
+            for ( int j = col; j < 6; j++ ) m[row][j] -= f * m[col][j];
+        }
+    }
+
+    setDeviation(m[0][5] / m[0][0], m[1][5] / m[1][1], m[2][5] / m[2][2], m[3][5] / m[3][3], m[4][5] / m[4][4]);
+    return true;
+}
+
+/**
+	GET DEVIATION
+	Get one of the deviation coefficients a - e, @see setDeviation().
+	
+	@since v1.3.0
+	@return float coefficient in degrees
+**/
+float QMC5883LCompass::getDeviation(uint8_t index){
+    return _deviation[index] / 100.;
+}
+
+/**
+	CLEAR DEVIATION
+	Switch deviation correction off.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::clearDeviation(){
+    for ( int i = 0; i < 5; i++ ) _deviation[i] = 0;
+    _deviationUse = false;
+    _invalidateCache();
+}
+
+/**
+	DEVIATION
+	Evaluate the deviation correction with integer math only.
+	
+	@since v1.3.0
+	@return long correction in hundredths of a degree
+**/
+long QMC5883LCompass::_deviationAt(long heading){
+    long sum = (long)_deviation[1] * _sin(heading)
+             + (long)_deviation[2] * _sin(heading + 9000)
+             + (long)_deviation[3] * _sin(2 * heading)
+             + (long)_deviation[4] * _sin(2 * heading + 9000);
+    return _deviation[0] + sum / 32767;
+}
+
+/**
+	SINE
+	Integer sine from a 5 degree table with linear interpolation, accurate to about 0.001.
+	
+	@since v1.3.0
+	@param angle in hundredths of a degree, any value
+	@return int sine scaled by 32767
+**/
+int QMC5883LCompass::_sin(long angle){
+    angle %= 36000;
+    if ( angle < 0 ) angle += 36000;
+
+    bool negative = angle >= 18000;
+    if ( negative ) angle -= 18000;
+    if ( angle > 9000 ) angle = 18000 - angle;
+
+    int index = angle / 500;
+    int fraction = angle % 500;
+    long value = (int16_t)pgm_read_word(&QMC5883L_SINE[index]);
+    if ( fraction ) {
+        long next = (int16_t)pgm_read_word(&QMC5883L_SINE[index + 1]);
+        value += ((next - value) * fraction) / 500;
+    }
+    return negative ? -value : value;
+}
+
 /**
 	GET AZIMUTH
 	Calculate the azimuth (in degrees);
-	Correct the value with magnetic declination if defined. 
+	Correct the value with the deviation table and magnetic declination if defined. 
 	
+	@since v1.3.0 - applies the deviation table.
 	@since v0.1;
 	@return int azimuth
 **/
 int QMC5883LCompass::getAzimuth(){
-    float heading = atan2( getY(), getX() ) * 180.0 / PI;
-    heading += _magneticDeclinationDegrees;
-    return (int)heading % 360;
+    return (int)(_correctedHeading() / 100) % 360;
+}
+
+/**
+	GET AZIMUTH IN CENTIDEGREES
+	Calculate the azimuth in hundredths of a degree, corrected like @see getAzimuth().
+	Unlike getAzimuth() the result is never negative, 0 is North and 9000 is East.
+	
+	@since v1.3.0
+	@return uint16_t azimuth 0 - 35999
+**/
+uint16_t QMC5883LCompass::getAzimuthCentidegrees(){
+    long heading = _correctedHeading() % 36000;
+    if ( heading < 0 ) heading += 36000;
+    return (uint16_t)heading;
+}
+
+/**
+	GET TILT COMPENSATED AZIMUTH
+	Same as @see getAzimuth(), but corrected for the sensor not being level, using the gravity
+	vector measured by an accelerometer (from any IMU). Without this the azimuth can be off by
+	tens of degrees when the sensor is tilted.
+	
+	The accelerometer axes must be aligned with the compass axes, and the accelerometer must read
+	a positive Z value when the sensor lies flat with its top up, like most accelerometers do.
+	The unit and range of the values do not matter. The math is all integer.
+	
+	Example:
+	
+	compass.read();
+	int a = compass.getAzimuth(imu.accelX, imu.accelY, imu.accelZ);
+	
+	@since v1.3.0
+	@return int azimuth
+**/
+int QMC5883LCompass::getAzimuth(int ax, int ay, int az){
+    return (int)(_correctHeading(_tiltHeading(ax, ay, az)) / 100) % 360;
+}
+
+/**
+	GET TILT COMPENSATED AZIMUTH IN CENTIDEGREES
+	Tilt compensated version of @see getAzimuthCentidegrees(), @see getAzimuth(int, int, int).
+	
+	@since v1.3.0
+	@return uint16_t azimuth 0 - 35999
+**/
+uint16_t QMC5883LCompass::getAzimuthCentidegrees(int ax, int ay, int az){
+    long heading = _correctHeading(_tiltHeading(ax, ay, az)) % 36000;
+    if ( heading < 0 ) heading += 36000;
+    return (uint16_t)heading;
+}
+
+/**
+	CORRECT HEADING
+	Apply the deviation table and magnetic declination to a heading from @see _heading().
+	
+	@since v1.3.0
+	@return long heading in hundredths of a degree, not normalized
+**/
+long QMC5883LCompass::_correctHeading(long heading){
+    if ( _deviationUse ) {
+        heading += _deviationAt(heading);
+    }
+    return heading + _magneticDeclination;
+}
+
+/**
+	CORRECTED HEADING
+	@see _correctHeading() of the current sample. It is calculated at most once per sample, so
+	calling getAzimuth(), getAzimuthCentidegrees() and getBearing() in a row costs a single atan2.
+	While the heading is held (@see setDisturbanceHold()) the last undisturbed heading is used.
+	
+	@since v1.3.0
+	@return long heading in hundredths of a degree, not normalized
+**/
+long QMC5883LCompass::_correctedHeading(){
+    if ( !_headingCached ) {
+        if ( !_headingHeld() ) {
+            _heldHeading = (int16_t)_heading();
+        }
+        _cachedHeading = _correctHeading(_heldHeading);
+        _headingCached = true;
+    }
+    return _cachedHeading;
+}
+
+/**
+	HEADING
+	Angle of the calibrated X / Y field, the same as atan2(y, x), @see _angle().
+	
+	@since v1.3.0
+	@return long heading in hundredths of a degree, -18000 to 18000
+**/
+long QMC5883LCompass::_heading(){
+    return _angle(getY(), getX());
+}
+
+/**
+	TILT COMPENSATED HEADING
+	Project the field onto the horizontal plane given by the gravity vector g and measure its
+	angle from the projection of the sensor's X axis. With B the field and G = |g| that is
+	
+	x = Bx * (gy^2 + gz^2) - gx * (By * gy + Bz * gz)
+	y = (By * gz - Bz * gy) * G
+	
+	which reduces to atan2(By, Bx) when level. Gravity is first scaled to 13 bits so the 64 bit
+	products can not overflow.
+	
+	@since v1.3.0
+	@return long heading in hundredths of a degree, -18000 to 18000
+**/
+long QMC5883LCompass::_tiltHeading(long ax, long ay, long az){
+    long g[3] = {ax, ay, az};
+    if ( !_scaleGravity(g) ) return _heading();
+
+    int64_t bx = getX();
+    int64_t by = getY();
+    int64_t bz = getZ();
+    unsigned long gravity = _sqrt((unsigned long)(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]));
+
+    int64_t x = bx * (g[1] * g[1] + g[2] * g[2]) - g[0] * (by * g[1] + bz * g[2]);
+    int64_t y = (by * g[2] - bz * g[1]) * (int64_t)gravity;
+
+    while ( x > 1073741823 || x < -1073741823 || y > 1073741823 || y < -1073741823 ) {
+        x /= 2;
+        y /= 2;
+    }
+    return _angle((long)y, (long)x);
+}
+
+/**
+	SCALE GRAVITY
+	Scale a gravity vector so its largest component is 4096 - 8191, keeping its direction.
+	
+	@since v1.3.0
+	@return bool false for a zero vector
+**/
+bool QMC5883LCompass::_scaleGravity(long *g){
+    unsigned long largest = 0;
+    for ( int i = 0; i < 3; i++ ) {
+        unsigned long a = ( g[i] < 0 ) ? -g[i] : g[i];
+        if ( a > largest ) largest = a;
+    }
+    if ( largest == 0 ) return false;
+
+    while ( largest >= 8192 ) {
+        largest >>= 1;
+        for ( int i = 0; i < 3; i++ ) g[i] /= 2;
+    }
+    while ( largest < 4096 ) {
+        largest <<= 1;
+        for ( int i = 0; i < 3; i++ ) g[i] *= 2;
+    }
+    return true;
 }
 
+/**
+	INCLINATION
+	Angle between the field and the plane at right angles to the gravity vector g, positive when
+	the field points down (away from g, which points up like an accelerometer at rest reads it).
+	With B the field and G = |g| the part of the field along g is v = (B . g) / G, and the
+	inclination is atan2(-v, sqrt(|B|^2 - v^2)).
+	
+	@since v1.3.0
+	@return long inclination in hundredths of a degree, -9000 to 9000
+**/
+long QMC5883LCompass::_inclination(long ax, long ay, long az){
+    long g[3] = {ax, ay, az};
+    if ( !_scaleGravity(g) ) {
+        g[0] = 0;
+        g[1] = 0;
+        g[2] = 4096;
+    }
+
+    long b[3] = {getX(), getY(), getZ()};
+    long dot = b[0] * g[0] + b[1] * g[1] + b[2] * g[2];
+    long gravity = (long)_sqrt((unsigned long)(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]));
+    long v = dot / gravity;
+
+    unsigned long squared = (unsigned long)(b[0] * b[0]) + (unsigned long)(b[1] * b[1]) + (unsigned long)(b[2] * b[2]);
+    unsigned long vertical = (unsigned long)( v < 0 ? -v : v );
+    vertical *= vertical;
+    unsigned long horizontal = ( squared > vertical ) ? _sqrt(squared - vertical) : 0;
+    return _angle(-v, (long)horizontal);
+}
+
+/**
+	ANGLE
+	The angle of (x, y), the same as atan2(y, x).
+	
+	By default this uses the integer @see _atan2(). Define QMC5883L_FLOAT_AZIMUTH when building
+	the library to use the float atan2() from the C library instead.
+	
+	@since v1.3.0
+	@return long angle in hundredths of a degree, -18000 to 18000
+**/
+long QMC5883LCompass::_angle(long y, long x){
+#ifdef QMC5883L_FLOAT_AZIMUTH
+    return (long)(atan2( (float)y, (float)x ) * 18000.0 / PI);
+#else
+    return _atan2(y, x);
+#endif
+}
+
+/**
+	SQUARE ROOT
+	Integer square root, rounded down, bit by bit without any division.
+	
+	@since v1.3.0
+**/
+unsigned long QMC5883LCompass::_sqrt(unsigned long value){
+    unsigned long root = 0;
+    unsigned long bit = 1UL << 30;
+    while ( bit > value ) bit >>= 2;
+    while ( bit ) {
+        if ( value >= root + bit ) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+/**
+	ATAN2
+	Integer replacement for atan2(). The arguments are reduced to the first octant, where the
+	ratio of the smaller to the larger one (15 bits) is looked up in a 33 entry table with linear
+	interpolation. No floats and a single division, so chips without an FPU need no float
+	library.
+	
+	The maximum error is 0.012 degrees (checked against atan2() for every pair of 16 bit inputs),
+	about twice the rounding of the result to hundredths of a degree. extras/linux/atan_test.cpp
+	repeats that check and times it against atan2f().
+	
+	@since v1.3.0
+	@return long angle in hundredths of a degree, -18000 to 18000, 0 for (0, 0)
+**/
+long QMC5883LCompass::_atan2(long y, long x){
+    unsigned long ax = ( x < 0 ) ? -x : x;
+    unsigned long ay = ( y < 0 ) ? -y : y;
+    if ( ax == 0 && ay == 0 ) return 0;
+
+    while ( ax > 32767 || ay > 32767 ) {
+        ax >>= 1;
+        ay >>= 1;
+    }
+
+    bool steep = ay > ax;
+    unsigned long ratio = steep ? (ax << 15) / ay : (ay << 15) / ax;
+    unsigned int index = ratio >> 10;
+    unsigned int fraction = ratio & 1023;
+
+    long angle = pgm_read_word(&QMC5883L_ATAN[index]);
+    if ( fraction ) {
+        long next = pgm_read_word(&QMC5883L_ATAN[index + 1]);
+        angle += ((next - angle) * fraction) >> 10;
+    }
+    angle = (angle + 5) / 10;
+
+    if ( steep ) angle = 9000 - angle;
+    if ( x < 0 ) angle = 18000 - angle;
+    return ( y < 0 ) ? -angle : angle;
+}
+
+
+/**
+	GET FIELD STRENGTH
+	Strength of the calibrated (and smoothed) field, sqrt(x^2 + y^2 + z^2), in sensor units.
+	Away from magnets and steel it stays about the same in every orientation.
+	
+	@since v1.3.0
+	@return unsigned int field strength
+**/
+unsigned int QMC5883LCompass::getFieldStrength(){
+    long x = getX();
+    long y = getY();
+    long z = getZ();
+    return (unsigned int)_sqrt((unsigned long)(x * x) + (unsigned long)(y * y) + (unsigned long)(z * z));
+}
+
+/**
+	GET INCLINATION
+	Inclination (dip) of the field in degrees, positive when the field points down as it does on
+	the northern hemisphere. Only correct when the sensor is level, @see getInclination(int, int, int).
+	
+	@since v1.3.0
+	@return int inclination -90 to 90
+**/
+int QMC5883LCompass::getInclination(){
+    return (int)(_inclination(0, 0, 1) / 100);
+}
+
+/**
+	GET TILT COMPENSATED INCLINATION
+	Same as @see getInclination(), in any orientation, using the gravity vector measured by an
+	accelerometer aligned with the compass, @see getAzimuth(int, int, int).
+	
+	@since v1.3.0
+	@return int inclination -90 to 90
+**/
+int QMC5883LCompass::getInclination(int ax, int ay, int az){
+    return (int)(_inclination(ax, ay, az) / 100);
+}
+
+/**
+	SET FIELD REFERENCE
+	Set the undisturbed field strength and inclination that @see isDisturbed() compares the
+	readings with. calibrate() sets the strength automatically, use @see captureFieldReference()
+	to take both from the current reading instead.
+	
+	@since v1.3.0
+	@param strength field strength as returned by getFieldStrength(), 0 turns detection off
+	@param inclination in degrees as returned by getInclination()
+**/
+void QMC5883LCompass::setFieldReference(unsigned int strength, int inclination){
+    _referenceStrength = strength;
+    _referenceInclination = (int16_t)(inclination * 100);
+    _invalidateCache();
+}
+
+/**
+	CAPTURE FIELD REFERENCE
+	Use the current reading as the undisturbed field, @see setFieldReference(). Call it with the
+	sensor level, in its final place and away from any temporary sources of disturbance.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::captureFieldReference(){
+    _referenceStrength = (uint16_t)getFieldStrength();
+    _referenceInclination = (int16_t)_inclination(0, 0, 1);
+    _invalidateCache();
+}
+
+/**
+	SET DISTURBANCE THRESHOLDS
+	How far a reading may be from the reference before it counts as disturbed.
+	
+	@since v1.3.0
+	@param strengthPercent allowed change of the field strength in percent, 15 by default,
+	       0 turns the strength check off
+	@param inclinationDegrees allowed change of the inclination in degrees, 0 (the default)
+	       turns the inclination check off. Only use it when the sensor stays level.
+**/
+void QMC5883LCompass::setDisturbanceThresholds(byte strengthPercent, byte inclinationDegrees){
+    _strengthTolerance = strengthPercent;
+    _inclinationTolerance = inclinationDegrees;
+    _invalidateCache();
+}
+
+/**
+	SET DISTURBANCE HOLD
+	When enabled, getAzimuth(), getAzimuthCentidegrees(), getBearing() and getDirection() keep
+	returning the last undisturbed heading while @see isDisturbed() is true. The tilt
+	compensated functions are not held.
+	
+	@since v1.3.0
+**/
+void QMC5883LCompass::setDisturbanceHold(bool hold){
+    _holdHeading = hold;
+    _invalidateCache();
+}
+
+/**
+	IS DISTURBED
+	Whether the current reading is disturbed by a nearby magnet, steel or current, found by
+	comparing the field strength and inclination with the reference, @see setFieldReference()
+	and @see setDisturbanceThresholds(). The heading can not be trusted while this is true.
+	It is evaluated at most once per sample.
+	
+	@since v1.3.0
+	@return bool true if disturbed, always false while no reference is set
+**/
+bool QMC5883LCompass::isDisturbed(){
+    if ( _disturbanceCached ) return _disturbed;
+
+    bool disturbed = false;
+    if ( _referenceStrength > 0 ) {
+        if ( _strengthTolerance > 0 ) {
+            long difference = (long)getFieldStrength() - _referenceStrength;
+            if ( difference < 0 ) difference = -difference;
+            disturbed = difference * 100 > (long)_referenceStrength * _strengthTolerance;
+        }
+        if ( !disturbed && _inclinationTolerance > 0 ) {
+            long difference = _inclination(0, 0, 1) - _referenceInclination;
+            if ( difference < 0 ) difference = -difference;
+            disturbed = difference > (long)_inclinationTolerance * 100;
+        }
+    }
+
+    _disturbed = disturbed;
+    _disturbanceCached = true;
+    return disturbed;
+}
+
+/**
+	HEADING HELD
+	@see setDisturbanceHold()
+	
+	@since v1.3.0
+	@return bool true while the heading is held
+**/
+bool QMC5883LCompass::_headingHeld(){
+    return _holdHeading && isDisturbed();
+}
 
 /**
 	GET BEARING
 	Divide the 360 degree circle into 16 equal parts and then return the a value of 0-15
-	based on where the azimuth is currently pointing.
+	based on where the azimuth is currently pointing. Each part is centered on its direction,
+	so 0 (N) covers 348.75 - 11.25 degrees.
 
  
+	@since v1.3.0 - integer math, parts are centered on their direction.
 	@since v1.2.1 - function takes into account negative azimuth values. Credit: https://github.com/prospark
 	@since v1.0.1 - function now requires azimuth parameter.
 	@since v0.2.0 - initial creation
@@ -515,11 +1844,82 @@ int QMC5883LCompass::getAzimuth(){
 	@return byte direction of bearing
 */
 byte QMC5883LCompass::getBearing(int azimuth){
-    unsigned long a = ( azimuth > -0.5 ) ? azimuth / 22.5 : (azimuth+360)/22.5;
-    unsigned long r = a - (int)a;
-    byte sexdec = 0;
-    sexdec = ( r >= .5 ) ? ceil(a) : floor(a);
-    return sexdec;
+    return QMC5883LCompassRose<16>::getBearing(azimuth);
+}
+
+/**
+	GET BEARING FROM XYZ
+	Same as @see getBearing(int) for the current reading, but the part is found by comparing
+	the calibrated X and Y values against the tangents of the part edges. There is no atan2()
+	and no float math at all, which makes it the cheapest way to get a direction when the
+	azimuth itself is not needed.
+	
+	The magnetic declination is applied by rotating X / Y with a precomputed integer sine and
+	cosine. When a deviation table is set the corrected azimuth is used instead.
+	
+	@since v1.3.0
+	@return byte direction of bearing
+*/
+byte QMC5883LCompass::getBearing(){
+    return _sector(16);
+}
+
+/**
+	SECTOR
+	Find which of (points) equal, centered parts of the compass rose the current reading
+	points into, @see getBearing().
+	
+	@since v1.3.0
+	@param points 4, 8, 16 or 32
+	@return byte part 0 - (points - 1), clockwise from North
+*/
+byte QMC5883LCompass::_sector(byte points){
+    if ( _cachedSectorPoints == points ) return _cachedSector;
+
+    // Split the circle into (points * 2) slices, a part is two slices centered on its direction.
+    byte slicesPerQuadrant = points / 2;
+
+    if ( _deviationUse || _headingHeld() ) {
+        return (byte)((((unsigned long)getAzimuthCentidegrees() * slicesPerQuadrant * 4 / 36000) + 1) / 2 % points);
+    }
+
+    long x = getX();
+    long y = getY();
+    if ( _magneticDeclination != 0 ) {
+        long rx = (x * _declinationCos - y * _declinationSin) / 32767;
+        long ry = (x * _declinationSin + y * _declinationCos) / 32767;
+        x = rx;
+        y = ry;
+    }
+
+    // Rotate into the first quadrant, 0 <= angle < 90, with u along the quadrant start.
+    byte quadrant;
+    unsigned long u;
+    unsigned long v;
+    if ( x > 0 && y >= 0 )       { quadrant = 0; u = x;  v = y;  }
+    else if ( x <= 0 && y > 0 )  { quadrant = 1; u = y;  v = -x; }
+    else if ( x < 0 && y <= 0 )  { quadrant = 2; u = -x; v = -y; }
+    else                         { quadrant = 3; u = -y; v = x;  }
+
+    // Count the slice edges below the angle. Below 45 degrees compare v / u with the edge
+    // tangents, above 45 degrees compare u / v with the mirrored ones.
+    byte step = 32 / points;
+    byte half = slicesPerQuadrant / 2;
+    byte slice = 0;
+    if ( v < u ) {
+        for ( byte j = 1; j < half; j++ ) {
+            if ( (v << 15) >= u * pgm_read_word(&QMC5883L_TAN[j * step - 1]) ) slice = j;
+        }
+    } else {
+        slice = slicesPerQuadrant - 1;
+        for ( byte j = 1; j < half; j++ ) {
+            if ( (u << 15) > v * pgm_read_word(&QMC5883L_TAN[j * step - 1]) ) slice = slicesPerQuadrant - 1 - j;
+        }
+    }
+
+    _cachedSector = (byte)((quadrant * slicesPerQuadrant + slice + 1) / 2 % points);
+    _cachedSectorPoints = points;
+    return _cachedSector;
 }
 
 
@@ -549,7 +1949,17 @@ byte QMC5883LCompass::getBearing(int azimuth){
 */
 void QMC5883LCompass::getDirection(char* myArray, int azimuth){
     int d = getBearing(azimuth);
-    myArray[0] = _bearings[d][0];
-    myArray[1] = _bearings[d][1];
-    myArray[2] = _bearings[d][2];
+    QMC5883LCompassRose<16>::getDirection(myArray, d);
+}
+
+/**
+	GET DIRECTION FROM XYZ
+	Same as @see getDirection(char*, int) but uses @see getBearing() to find the direction
+	of the current reading without calculating the azimuth.
+	
+	@since v1.3.0
+*/
+void QMC5883LCompass::getDirection(char* myArray){
+    int d = getBearing();
+    QMC5883LCompassRose<16>::getDirection(myArray, d);
 }
@@ -1,82 +1,279 @@
 #ifndef QMC5883L_Compass
 #define QMC5883L_Compass
 
-#include "Arduino.h"
-#include "Wire.h"
+#include "QMC5883LPlatform.h"
+#include "QMC5883LLock.h"
+
+/**
+	One point of a temperature compensation table, @see setTemperatureCompensation().
+	The offsets are added to and the scales multiplied with the regular calibration.
+**/
+struct QMC5883LTemperaturePoint {
+    int temperature;
+    float offset[3];
+    float scale[3];
+};
+
+/**
+	A consistent copy of the latest sample, @see QMC5883LCompass::getSample().
+**/
+struct QMC5883LSample {
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int16_t temperature;
+    uint16_t azimuth;
+    uint16_t sequence;
+    byte readErrors;
+};
+
+/**
+	An unprocessed sample from @see QMC5883LCompass::readRaw().
+**/
+struct QMC5883LRawSample {
+    unsigned long timestamp;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int16_t temperature;
+    byte status;
+};
+
+// atan() of 0 - 1 in 1/32 steps, in thousandths of a degree, @see QMC5883LBatch.
+extern const uint16_t QMC5883L_ATAN[33] PROGMEM;
+
+// Names of the 32 compass directions, right aligned, @see QMC5883LCompassRose.
+extern const char QMC5883L_DIRECTIONS[32][4] PROGMEM;
+
+template <byte POINTS> class QMC5883LCompassRose;
+template <byte N> class QMC5883LArray;
+class QMC5883LMux;
+class QMC5883LPipeline;
+class QMC5883LBatch;
 
 class QMC5883LCompass{
 
+    template <byte POINTS> friend class QMC5883LCompassRose;
+    template <byte N> friend class QMC5883LArray;
+    friend class QMC5883LPipeline;
+    friend class QMC5883LBatch;
+    friend class QMC5883LLogWriter;
+
 public:
     QMC5883LCompass();
     void init();
     void init(TwoWire *twi);
     void setADDR(byte b);
+    void setMultiplexer(QMC5883LMux *mux, byte channel);
     void setAutocalibrate(bool autoCalibrateEnabled);
     void setMode(byte mode, byte odr, byte rng, byte osr);
     void setMagneticDeclination(int degrees, uint8_t minutes);
+    void setMagneticDeclination(float latitude, float longitude, float year);
+    float getMagneticDeclination();
     void setSmoothing(byte steps, bool adv);
     void calibrate(unsigned int seconds, void (*callback)(float, bool));
+    void setCalibrationTargets(byte coverage, byte quality);
+    byte getCalibrationCoverage();
+    uint32_t getCalibrationCoverageMap();
+    byte getCalibrationQuality();
+    bool hasCalibrationQuality();
+    float getCalibrationResidual();
+    float getCalibrationFieldVariance();
+    void setCalibrationTracking(bool enabled);
     void setCalibration(int x_min, int x_max, int y_min, int y_max, int z_min, int z_max);
     void setCalibrationOffsets(float x_offset, float y_offset, float z_offset);
     void setCalibrationScales(float x_scale, float y_scale, float z_scale);
     float getCalibrationOffset(uint8_t index);
     float getCalibrationScale(uint8_t index);
     void clearCalibration();
+    void enableTemperature(bool enabled);
+    void setTemperatureOffset(int offset);
+    int getTemperature();
+    void setTemperatureCompensation(const QMC5883LTemperaturePoint *table, byte count);
     void setReset();
     bool read();
+    bool readRaw(QMC5883LRawSample *raw);
+    bool process(const QMC5883LRawSample *raw);
+    bool isDataReady();
+    uint16_t getSequence();
+    void getSample(QMC5883LSample *sample);
+    byte getReadErrors();
     int getX();
     int getY();
     int getZ();
+    void setDeviation(float a, float b, float c, float d, float e);
+    bool fitDeviation(const int *compassHeadings, const int *magneticHeadings, byte count);
+    float getDeviation(uint8_t index);
+    void clearDeviation();
     int getAzimuth();
+    uint16_t getAzimuthCentidegrees();
+    int getAzimuth(int ax, int ay, int az);
+    uint16_t getAzimuthCentidegrees(int ax, int ay, int az);
+    unsigned int getFieldStrength();
+    int getInclination();
+    int getInclination(int ax, int ay, int az);
+    void setFieldReference(unsigned int strength, int inclination);
+    void captureFieldReference();
+    void setDisturbanceThresholds(byte strengthPercent, byte inclinationDegrees);
+    void setDisturbanceHold(bool hold);
+    bool isDisturbed();
     byte getBearing(int azimuth);
+    byte getBearing();
     void getDirection(char* myArray, int azimuth);
+    void getDirection(char* myArray);
 
 private:
     bool _applyCalibrationIfNecessary(int x, int y, int z);
-    bool _autoCalibrate = false;
+    void _updateCoverage(int x, int y, int z);
+    bool _calibrationTargetsMet();
+    void _calibrationFromRange(int x_min, int x_max, int y_min, int y_max, int z_min, int z_max, float *offset, float *scale);
+    void _resetFitStats();
+    void _updateFitStats(float x, float y, float z);
+    bool _select();
+    void _copySample(QMC5883LSample *sample);
+    void _readFailed();
     void _writeReg(byte reg,byte val);
+    void _setDeclination(float degrees);
     int _get(int index);
-    float _magneticDeclinationDegrees = 0;
-    bool _smoothUse = false;
-    byte _smoothSteps = 5;
-    bool _smoothAdvanced = false;
-    byte _ADDR = 0x0D;
-    int _vRaw[3] = {0,0,0};
-    int _vHistory[10][3];
-    int _vScan = 0;
-    long _vTotals[3] = {0,0,0};
-    int _vSmooth[3] = {0,0,0};
+    long _deviationAt(long heading);
+    static int _sin(long angle);
+    static long _atan2(long y, long x);
+    static unsigned long _sqrt(unsigned long value);
+    static long _angle(long y, long x);
+    long _heading();
+    long _correctedHeading();
+    void _invalidateCache();
+    long _tiltHeading(long ax, long ay, long az);
+    static bool _scaleGravity(long *g);
+    long _inclination(long ax, long ay, long az);
+    bool _headingHeld();
+    long _correctHeading(long heading);
+    byte _sector(byte points);
     void _smoothing();
-    float _offset[3] = {0.,0.,0.};
-    float _scale[3] = {1.,1.,1.};
-    int _vCalibrated[3];
+    void _updateCalibrationCoefficients();
+    void _temperatureCorrection(float *offset, float *scale);
     void _applyCalibration();
-    const char _bearings[16][3] =  {
-            {' ', ' ', 'N'},
-            {'N', 'N', 'E'},
-            {' ', 'N', 'E'},
-            {'E', 'N', 'E'},
-            {' ', ' ', 'E'},
-            {'E', 'S', 'E'},
-            {' ', 'S', 'E'},
-            {'S', 'S', 'E'},
-            {' ', ' ', 'S'},
-            {'S', 'S', 'W'},
-            {' ', 'S', 'W'},
-            {'W', 'S', 'W'},
-            {' ', ' ', 'W'},
-            {'W', 'N', 'W'},
-            {' ', 'N', 'W'},
-            {'N', 'N', 'W'},
-    };
+    int16_t _calibrated(byte axis, int16_t raw);
+
+    // Members are ordered by size to avoid padding, the narrowest type that holds each value is
+    // used and the nine flags at the end are one bit fields in two bytes. Constant tables live
+    // in flash, shared by all instances, see the top of QMC5883LCompass.cpp.
     TwoWire *wire;
+    const QMC5883LTemperaturePoint *_temperatureTable = nullptr;
+    QMC5883LMux *_mux = nullptr;
+
+    uint32_t _coverageMap = 0;
+    unsigned long _fitCount = 0;
+    float _fitMean = 0;
+    float _fitM2 = 0;
+    float _offset[3] = {0.,0.,0.};
+    float _scale[3] = {1.,1.,1.};
+    int32_t _offsetQ8[3] = {0,0,0};
+    int32_t _scaleQ24[3] = {16777216L,16777216L,16777216L};
+    long _vTotals[3] = {0,0,0};
+    int32_t _cachedHeading = 0;
+
+    int16_t _vRaw[3] = {0,0,0};
+    int16_t _vCalibrated[3] = {0,0,0};
+    int16_t _vSmooth[3] = {0,0,0};
+    int16_t _vHistory[10][3];
+    int16_t minX = INT16_MAX;
+    int16_t minY = INT16_MAX;
+    int16_t minZ = INT16_MAX;
+    int16_t maxX = INT16_MIN;
+    int16_t maxY = INT16_MIN;
+    int16_t maxZ = INT16_MIN;
+    int16_t _magneticDeclination = 0;
+    int16_t _declinationSin = 0;
+    int16_t _declinationCos = 32767;
+    int16_t _deviation[5] = {0,0,0,0,0};
+    int16_t _temperature = 0;
+    int16_t _compensatedTemperature = 0;
+    int16_t _temperatureOffset = 0;
+    uint16_t _sequence = 0;
+    uint16_t _referenceStrength = 0;
+    int16_t _referenceInclination = 0;
+    int16_t _heldHeading = 0;
+    volatile uint16_t _seqlock = 0;
+
+    byte _ADDR = 0x0D;
+    byte _muxChannel = 0;
+    byte _readErrors = 0;
+    byte _coverageTarget = 0;
+    byte _qualityTarget = 0;
+    byte _smoothSteps = 5;
+    byte _vScan = 0;
+    byte _status = 0;
+    byte _control = 0;
+    byte _temperatureTableSize = 0;
+    byte _cachedSector = 0;
+    byte _cachedSectorPoints = 0;
+    byte _strengthTolerance = 15;
+    byte _inclinationTolerance = 0;
+    // Not a bit field, as readRaw() reads it while process() on another thread writes the flags.
+    bool _readTemperature = false;
+
+    bool _autoCalibrate : 1;
+    bool _smoothUse : 1;
+    bool _smoothAdvanced : 1;
+    bool _deviationUse : 1;
+    bool _headingCached : 1;
+    bool _disturbanceCached : 1;
+    bool _disturbed : 1;
+    bool _holdHeading : 1;
+    bool _fitTracking : 1;
+};
+
+/**
+	COMPASS ROSE
+	A compass rose with a resolution chosen at compile time: 4 (N, E, S, W), 8, 16 or 32
+	(N, NbE, NNE, NEbN, ...) points. Everything is integer math and the direction names are
+	read from one shared table in flash, so coarser roses cost nothing extra.
+	
+	Example:
+	
+	typedef QMC5883LCompassRose<8> Rose;
+	
+	byte b = Rose::getBearing(compass);
+	char name[Rose::NAME_LENGTH];
+	Rose::getDirection(name, b);
+	
+	@since v1.3.0
+**/
+template <byte POINTS>
+class QMC5883LCompassRose {
+    static_assert(POINTS == 4 || POINTS == 8 || POINTS == 16 || POINTS == 32, "A compass rose has 4, 8, 16 or 32 points");
+
+public:
+    // Characters written by getDirection(), names are right aligned and padded with spaces.
+    static const byte NAME_LENGTH = ( POINTS == 32 ) ? 4 : 3;
+
+    /**
+    	Point 0 - (POINTS - 1) of an azimuth in degrees, clockwise from North. Each point is
+    	centered on its direction.
+    **/
+    static byte getBearing(int azimuth) {
+        long a = azimuth % 360;
+        if ( a < 0 ) a += 360;
+        return (byte)(((a * POINTS * 2 + 360) / 720) % POINTS);
+    }
+
+    /**
+    	Point of the compass' current reading, found from the calibrated X / Y values without
+    	calculating the azimuth, @see QMC5883LCompass::getBearing().
+    **/
+    static byte getBearing(QMC5883LCompass &compass) {
+        return compass._sector(POINTS);
+    }
 
-    int minX = (int)65000;
-    int minY = (int)65000;
-    int minZ = (int)65000;
-    int maxX = (int)-65000;
-    int maxY = (int)-65000;
-    int maxZ = (int)-65000;
+    /**
+    	Write the NAME_LENGTH characters of the name of a point into myArray.
+    **/
+    static void getDirection(char* myArray, byte bearing) {
+        for ( byte i = 0; i < NAME_LENGTH; i++ ) {
+            myArray[i] = pgm_read_byte(&QMC5883L_DIRECTIONS[(bearing % POINTS) * (32 / POINTS)][4 - NAME_LENGTH + i]);
+        }
+    }
 };
 
 #endif
@@ -0,0 +1,210 @@
+/*
+===============================================================================================================
+QMC5883LDeclination.h
+Magnetic declination for the QMC5883L Compass library.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Uses the coefficients of the World Magnetic Model 2025 (NOAA NCEI / British Geological Survey,
+public domain), truncated to degree and order 10. Main field coefficients are rounded to 1 nT and
+secular variation to 0.1 nT per year. Compared to the full model this changes the declination by
+less than 0.15 degrees between 60 degrees South and North.
+
+The model is valid from 2025.0 to 2030.0. Dates outside of that are held at the nearest end
+instead of extrapolating the secular variation, see isValid(); replace the table with the
+coefficients of a newer model to stay accurate.
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LDeclination.h"
+
+#define QMC5883L_WMM_DEGREE 10
+#define QMC5883L_WMM_EPOCH 2025.0
+#define QMC5883L_WMM_YEARS 5.0
+
+// g, h in nT and their secular variation in 0.1 nT per year, for n = 1 - 10 and m = 0 - n.
+static const int16_t QMC5883L_WMM[65][4] PROGMEM = {
+    // n = 1
+    { -29352,      0,  120,    0},
+    {  -1411,   4545,   97, -215},
+    // n = 2
+    {  -2557,      0, -116,    0},
+    {   2951,  -3134,  -52, -277},
+    {   1649,   -815,  -80, -121},
+    // n = 3
+    {   1361,      0,  -13,    0},
+    {  -2404,    -57,  -42,   40},
+    {   1244,    238,    4,   -3},
+    {    454,   -550, -156,  -41},
+    // n = 4
+    {    895,      0,  -16,    0},
+    {    800,    279,  -24,  -11},
+    {     56,   -134,  -60,   41},
+    {   -281,    212,   56,   16},
+    {     12,   -376,  -70,  -44},
+    // n = 5
+    {   -233,      0,    6,    0},
+    {    369,     45,   14,   -5},
+    {    187,    220,    0,   22},
+    {   -139,   -123,    6,    4},
+    {   -142,     43,   22,   17},
+    {     21,    106,    9,   19},
+    // n = 6
+    {     64,      0,   -2,    0},
+    {     64,    -18,   -4,    3},
+    {     77,     17,    9,  -16},
+    {   -116,     49,   12,   -4},
+    {    -41,    -60,   -9,    9},
+    {     15,     11,    3,    7},
+    {    -61,     73,    9,    9},
+    // n = 7
+    {     80,      0,    0,    0},
+    {    -77,    -49,   -1,    6},
+    {     -9,    -14,   -1,    5},
+    {     59,     -1,    5,   -8},
+    {     16,     23,   -1,    0},
+    {      3,     -7,   -8,  -10},
+    {    -11,    -25,   -8,    6},
+    {     14,     -2,    8,   -2},
+    // n = 8
+    {     23,      0,   -1,    0},
+    {     11,      7,    2,   -2},
+    {    -18,    -13,    0,    5},
+    {      2,     11,    5,   -4},
+    {    -22,    -10,   -1,    4},
+    {     17,     13,    3,   -5},
+    {     15,      1,    2,   -6},
+    {    -17,     -5,    0,    3},
+    {      1,      4,    2,    2},
+    // n = 9
+    {      5,      0,    0,    0},
+    {      8,    -25,   -1,   -3},
+    {      3,     12,    1,    3},
+    {      0,      8,    3,   -3},
+    {     -3,     -3,   -3,    3},
+    {    -13,     -5,    0,    2},
+    {      2,      7,    3,   -1},
+    {      9,     -1,   -1,   -2},
+    {     -9,      1,    1,    4},
+    {    -13,     10,   -1,    1},
+    // n = 10
+    {     -1,      0,    1,    0},
+    {     -6,      3,    0,    0},
+    {      0,      0,    1,    0},
+    {      2,      2,    1,   -2},
+    {     -1,      5,    0,    1},
+    {     -1,     -9,   -3,   -1},
+    {     -1,      0,    0,    1},
+    {      2,     -4,   -1,    0},
+    {      1,     -4,   -1,   -1},
+    {     -3,      1,    0,    2},
+    {     -4,     -9,    0,    0},
+};
+
+/**
+	IS VALID
+	Whether a date lies within the validity window of the model. @see getDeclination() holds
+	dates outside of it at the nearest end, so its result gets less accurate the further away
+	the date is.
+	
+	@since v1.3.0
+	@param year decimal year
+	@return bool true from 2025.0 to 2030.0
+**/
+bool QMC5883LDeclination::isValid(float year){
+    return year >= QMC5883L_WMM_EPOCH && year <= QMC5883L_WMM_EPOCH + QMC5883L_WMM_YEARS;
+}
+
+/**
+	GET DECLINATION
+	Calculate the magnetic declination at sea level. The spherical harmonic sum takes a few
+	thousand float operations, so calculate it once for a location and keep the result.
+	
+	@since v1.3.0
+	@param latitude in degrees, North positive
+	@param longitude in degrees, East positive
+	@param year decimal year, e.g. 2026.5 for the start of July 2026, held at 2025.0 - 2030.0
+	@return float declination in degrees, East positive
+**/
+float QMC5883LDeclination::getDeclination(float latitude, float longitude, float year){
+    // WGS 84 ellipsoid and the geomagnetic reference radius, in km.
+    const float a = 6378.137;
+    const float e2 = 0.0066943800;
+    const float referenceRadius = 6371.2;
+
+    // Geodetic to geocentric coordinates.
+    float phi = latitude * PI / 180.0;
+    float lambda = longitude * PI / 180.0;
+    float sinPhi = sin(phi);
+    float rc = a / sqrt(1. - e2 * sinPhi * sinPhi);
+    float p = rc * cos(phi);
+    float z = rc * (1. - e2) * sinPhi;
+    float r = sqrt(p * p + z * z);
+    float phiC = asin(z / r);
+
+    // Schmidt semi-normalized Legendre functions of the colatitude, one row at a time.
+    float cosTheta = sin(phiC);
+    float sinTheta = cos(phiC);
+    if ( sinTheta < 1e-6 ) sinTheta = 1e-6;
+
+    float P[3][QMC5883L_WMM_DEGREE + 1];
+    float dP[3][QMC5883L_WMM_DEGREE + 1];
+    P[0][0] = 1.;
+    dP[0][0] = 0.;
+
+    // The secular variation is only good for the validity window, so do not extrapolate it.
+    float dt = year - QMC5883L_WMM_EPOCH;
+    if ( dt < 0. ) dt = 0.;
+    if ( dt > QMC5883L_WMM_YEARS ) dt = QMC5883L_WMM_YEARS;
+    float ratio = referenceRadius / r;
+    float power = ratio * ratio;
+    float north = 0.;
+    float east = 0.;
+    float down = 0.;
+    int index = 0;
+
+    for ( int n = 1; n <= QMC5883L_WMM_DEGREE; n++ ) {
+        float *row = P[n % 3];
+        float *dRow = dP[n % 3];
+        float *prev = P[(n + 2) % 3];
+        float *dPrev = dP[(n + 2) % 3];
+        float *prev2 = P[(n + 1) % 3];
+        float *dPrev2 = dP[(n + 1) % 3];
+
+        for ( int m = 0; m <= n; m++ ) {
+            if ( n == m ) {
+                float k = ( n == 1 ) ? 1. : sqrt(1. - 1. / (2. * n));
+                row[m] = k * sinTheta * prev[m - 1];
+                dRow[m] = k * (sinTheta * dPrev[m - 1] + cosTheta * prev[m - 1]);
+            } else {
+                float k1 = (2. * n - 1.) / sqrt((float)(n * n - m * m));
+                float k2 = ( n - 1 > m ) ? sqrt((float)((n - 1) * (n - 1) - m * m) / (float)(n * n - m * m)) : 0.;
+                float p2 = ( n - 1 > m ) ? prev2[m] : 0.;
+                float dp2 = ( n - 1 > m ) ? dPrev2[m] : 0.;
+                row[m] = k1 * cosTheta * prev[m] - k2 * p2;
+                dRow[m] = k1 * (cosTheta * dPrev[m] - sinTheta * prev[m]) - k2 * dp2;
+            }
+        }
+
+        power *= ratio;
+        for ( int m = 0; m <= n; m++, index++ ) {
+            float g = (int16_t)pgm_read_word(&QMC5883L_WMM[index][0]) + (int16_t)pgm_read_word(&QMC5883L_WMM[index][2]) * dt / 10.;
+            float h = (int16_t)pgm_read_word(&QMC5883L_WMM[index][1]) + (int16_t)pgm_read_word(&QMC5883L_WMM[index][3]) * dt / 10.;
+            float cosM = cos(m * lambda);
+            float sinM = sin(m * lambda);
+            north += power * (g * cosM + h * sinM) * dRow[m];
+            east += power * m * (g * sinM - h * cosM) * row[m] / sinTheta;
+            down -= (n + 1) * power * (g * cosM + h * sinM) * row[m];
+        }
+    }
+
+    // Rotate from the geocentric back to the geodetic frame. East does not change and the
+    // declination only needs north.
+    float psi = phiC - phi;
+    north = north * cos(psi) - down * sin(psi);
+
+    return atan2(east, north) * 180.0 / PI;
+}
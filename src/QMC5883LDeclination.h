@@ -0,0 +1,17 @@
+#ifndef QMC5883L_Declination
+#define QMC5883L_Declination
+
+#include "QMC5883LPlatform.h"
+
+/**
+	Magnetic declination from a compact World Magnetic Model, @see
+	QMC5883LCompass::setMagneticDeclination(float, float, float).
+**/
+class QMC5883LDeclination{
+
+public:
+    static float getDeclination(float latitude, float longitude, float year);
+    static bool isValid(float year);
+};
+
+#endif
@@ -0,0 +1,386 @@
+/*
+===============================================================================================================
+QMC5883LFusion.h
+Orientation fusion for the QMC5883L Compass library.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Based on the gradient descent orientation filter by Sebastian Madgwick,
+"An efficient orientation filter for inertial and inertial/magnetic sensor arrays" (2010).
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LFusion.h"
+
+QMC5883LFusion::QMC5883LFusion() {
+}
+
+/**
+	SET BETA
+	Filter gain. Higher values trust the accelerometer and magnetometer more and correct gyro
+	drift faster, lower values trust the gyro more and give a smoother output.
+	
+	@since v1.3.0
+	@param beta gain, 0.1 by default, 0.033 - 0.5 are typical
+**/
+void QMC5883LFusion::setBeta(float beta){
+    _beta = beta;
+}
+
+/**
+	SET ZETA
+	Gain of the gyro bias compensation. The filter learns the constant error of the gyro, so it
+	no longer has to hold it off with an orientation error. Higher values learn it faster, but
+	also learn a magnetic disturbance as gyro error, which then takes longer to go away. 0 turns
+	the compensation off.
+	
+	@since v1.3.0
+	@param zeta gain in radians per second, 0.005 by default
+**/
+void QMC5883LFusion::setZeta(float zeta){
+    _zeta = zeta;
+}
+
+/**
+	RESET
+	Forget the orientation. The filter starts over from level and pointing North, until the
+	next update() with an accelerometer and a field sample sets it from them.
+	
+	@since v1.3.0
+**/
+void QMC5883LFusion::reset(){
+    _q[0] = 1.;
+    _q[1] = 0.;
+    _q[2] = 0.;
+    _q[3] = 0.;
+    for ( int i = 0; i < 3; i++ ) _bias[i] = 0.;
+    _started = false;
+}
+
+/**
+	UPDATE
+	Add one gyro, accelerometer and magnetometer sample.
+	
+	@since v1.3.0
+	@param gx, gy, gz angular rate in radians per second
+	@param ax, ay, az acceleration, any unit
+	@param mx, my, mz magnetic field, any unit. All 0 runs @see updateIMU() instead.
+	@param dt time since the previous update in seconds
+**/
+void QMC5883LFusion::update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt){
+    if ( mx == 0. && my == 0. && mz == 0. ) {
+        updateIMU(gx, gy, gz, ax, ay, az, dt);
+        return;
+    }
+    if ( !_started && _start(ax, ay, az, mx, my, mz) ) return;
+
+    float q0 = _q[0];
+    float q1 = _q[1];
+    float q2 = _q[2];
+    float q3 = _q[3];
+
+    // Rate of change of the quaternion from the gyro.
+    float qDot[4] = {
+        0.5f * (-q1 * gx - q2 * gy - q3 * gz),
+        0.5f * (q0 * gx + q2 * gz - q3 * gy),
+        0.5f * (q0 * gy - q1 * gz + q3 * gx),
+        0.5f * (q0 * gz + q1 * gy - q2 * gx)
+    };
+
+    if ( !(ax == 0. && ay == 0. && az == 0.) ) {
+        float norm = 1. / sqrt(ax * ax + ay * ay + az * az);
+        ax *= norm;
+        ay *= norm;
+        az *= norm;
+
+        norm = 1. / sqrt(mx * mx + my * my + mz * mz);
+        mx *= norm;
+        my *= norm;
+        mz *= norm;
+
+        float _2q0mx = 2.0f * q0 * mx;
+        float _2q0my = 2.0f * q0 * my;
+        float _2q0mz = 2.0f * q0 * mz;
+        float _2q1mx = 2.0f * q1 * mx;
+        float _2q0 = 2.0f * q0;
+        float _2q1 = 2.0f * q1;
+        float _2q2 = 2.0f * q2;
+        float _2q3 = 2.0f * q3;
+        float _2q0q2 = 2.0f * q0 * q2;
+        float _2q2q3 = 2.0f * q2 * q3;
+        float q0q0 = q0 * q0;
+        float q0q1 = q0 * q1;
+        float q0q2 = q0 * q2;
+        float q0q3 = q0 * q3;
+        float q1q1 = q1 * q1;
+        float q1q2 = q1 * q2;
+        float q1q3 = q1 * q3;
+        float q2q2 = q2 * q2;
+        float q2q3 = q2 * q3;
+        float q3q3 = q3 * q3;
+
+        // Direction of the earth's field, in the earth frame, as seen with the current estimate.
+        float hx = mx * q0q0 - _2q0my * q3 + _2q0mz * q2 + mx * q1q1 + _2q1 * my * q2 + _2q1 * mz * q3 - mx * q2q2 - mx * q3q3;
+        float hy = _2q0mx * q3 + my * q0q0 - _2q0mz * q1 + _2q1mx * q2 - my * q1q1 + my * q2q2 + _2q2 * mz * q3 - my * q3q3;
+        float _2bx = sqrt(hx * hx + hy * hy);
+        float _2bz = -_2q0mx * q2 + _2q0my * q1 + mz * q0q0 + _2q1mx * q3 - mz * q1q1 + _2q2 * my * q3 - mz * q2q2 + mz * q3q3;
+        float _4bx = 2.0f * _2bx;
+        float _4bz = 2.0f * _2bz;
+
+        // Gradient of the error between the measured and the expected gravity and field.
+        float fgx = 2.0f * q1q3 - _2q0q2 - ax;
+        float fgy = 2.0f * q0q1 + _2q2q3 - ay;
+        float fgz = 1.0f - 2.0f * q1q1 - 2.0f * q2q2 - az;
+        float fmx = _2bx * (0.5f - q2q2 - q3q3) + _2bz * (q1q3 - q0q2) - mx;
+        float fmy = _2bx * (q1q2 - q0q3) + _2bz * (q0q1 + q2q3) - my;
+        float fmz = _2bx * (q0q2 + q1q3) + _2bz * (0.5f - q1q1 - q2q2) - mz;
+
+        float s[4] = {
+            -_2q2 * fgx + _2q1 * fgy - _2bz * q2 * fmx + (-_2bx * q3 + _2bz * q1) * fmy + _2bx * q2 * fmz,
+            _2q3 * fgx + _2q0 * fgy - 4.0f * q1 * fgz + _2bz * q3 * fmx + (_2bx * q2 + _2bz * q0) * fmy + (_2bx * q3 - _4bz * q1) * fmz,
+            -_2q0 * fgx + _2q3 * fgy - 4.0f * q2 * fgz + (-_4bx * q2 - _2bz * q0) * fmx + (_2bx * q1 + _2bz * q3) * fmy + (_2bx * q0 - _4bz * q2) * fmz,
+            _2q1 * fgx + _2q2 * fgy + (-_4bx * q3 + _2bz * q1) * fmx + (-_2bx * q0 + _2bz * q2) * fmy + _2bx * q1 * fmz
+        };
+
+        norm = sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2] + s[3] * s[3]);
+        if ( norm > 0. ) {
+            norm = 1. / norm;
+            for ( int i = 0; i < 4; i++ ) s[i] *= norm;
+            _compensate(s, qDot, gx, gy, gz, dt);
+            for ( int i = 0; i < 4; i++ ) qDot[i] -= _beta * s[i];
+        }
+    }
+
+    _integrate(qDot, dt);
+}
+
+/**
+	UPDATE FROM COMPASS
+	Same as @see update() with the calibrated field of the compass' last read().
+	
+	@since v1.3.0
+**/
+void QMC5883LFusion::update(QMC5883LCompass &compass, float gx, float gy, float gz, float ax, float ay, float az, float dt){
+    update(gx, gy, gz, ax, ay, az, compass.getX(), compass.getY(), compass.getZ(), dt);
+}
+
+/**
+	UPDATE WITHOUT MAGNETOMETER
+	Add a gyro and accelerometer sample only, for gyro samples that arrive between two compass
+	readings. Pitch and roll are corrected, the heading follows the gyro.
+	
+	@since v1.3.0
+**/
+void QMC5883LFusion::updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float dt){
+    float q0 = _q[0];
+    float q1 = _q[1];
+    float q2 = _q[2];
+    float q3 = _q[3];
+
+    float qDot[4] = {
+        0.5f * (-q1 * gx - q2 * gy - q3 * gz),
+        0.5f * (q0 * gx + q2 * gz - q3 * gy),
+        0.5f * (q0 * gy - q1 * gz + q3 * gx),
+        0.5f * (q0 * gz + q1 * gy - q2 * gx)
+    };
+
+    if ( !(ax == 0. && ay == 0. && az == 0.) ) {
+        float norm = 1. / sqrt(ax * ax + ay * ay + az * az);
+        ax *= norm;
+        ay *= norm;
+        az *= norm;
+
+        float _2q0 = 2.0f * q0;
+        float _2q1 = 2.0f * q1;
+        float _2q2 = 2.0f * q2;
+        float _2q3 = 2.0f * q3;
+        float _4q0 = 4.0f * q0;
+        float _4q1 = 4.0f * q1;
+        float _4q2 = 4.0f * q2;
+        float _8q1 = 8.0f * q1;
+        float _8q2 = 8.0f * q2;
+        float q0q0 = q0 * q0;
+        float q1q1 = q1 * q1;
+        float q2q2 = q2 * q2;
+        float q3q3 = q3 * q3;
+
+        float s[4] = {
+            _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay,
+            _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az,
+            4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az,
+            4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay
+        };
+
+        norm = sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2] + s[3] * s[3]);
+        if ( norm > 0. ) {
+            norm = 1. / norm;
+            for ( int i = 0; i < 4; i++ ) s[i] *= norm;
+            _compensate(s, qDot, gx, gy, gz, dt);
+            for ( int i = 0; i < 4; i++ ) qDot[i] -= _beta * s[i];
+        }
+    }
+
+    _integrate(qDot, dt);
+}
+
+/**
+	START
+	Set the orientation from one accelerometer and field sample: up is the acceleration, West
+	is up x field, and North is West x up. These are the rows of the rotation matrix from the
+	sensor to the earth frame, which is turned into a quaternion.
+	
+	@since v1.3.0
+	@return bool false if the two vectors are 0 or parallel, the orientation is not changed
+**/
+bool QMC5883LFusion::_start(float ax, float ay, float az, float mx, float my, float mz){
+    float up[3] = {ax, ay, az};
+    float west[3] = {ay * mz - az * my, az * mx - ax * mz, ax * my - ay * mx};
+    float upLength = sqrt(ax * ax + ay * ay + az * az);
+    float westLength = sqrt(west[0] * west[0] + west[1] * west[1] + west[2] * west[2]);
+    if ( upLength == 0. || westLength == 0. ) return false;
+    for ( int i = 0; i < 3; i++ ) {
+        up[i] /= upLength;
+        west[i] /= westLength;
+    }
+    float north[3] = {
+        west[1] * up[2] - west[2] * up[1],
+        west[2] * up[0] - west[0] * up[2],
+        west[0] * up[1] - west[1] * up[0]
+    };
+    const float *r[3] = {north, west, up};
+
+    // The largest of the four terms gives the most accurate square root.
+    float trace = r[0][0] + r[1][1] + r[2][2];
+    float s;
+    if ( trace > 0. ) {
+        s = 2.0f * sqrt(1.0f + trace);
+        _q[0] = 0.25f * s;
+        _q[1] = (r[2][1] - r[1][2]) / s;
+        _q[2] = (r[0][2] - r[2][0]) / s;
+        _q[3] = (r[1][0] - r[0][1]) / s;
+    } else if ( r[0][0] > r[1][1] && r[0][0] > r[2][2] ) {
+        s = 2.0f * sqrt(1.0f + r[0][0] - r[1][1] - r[2][2]);
+        _q[0] = (r[2][1] - r[1][2]) / s;
+        _q[1] = 0.25f * s;
+        _q[2] = (r[0][1] + r[1][0]) / s;
+        _q[3] = (r[0][2] + r[2][0]) / s;
+    } else if ( r[1][1] > r[2][2] ) {
+        s = 2.0f * sqrt(1.0f + r[1][1] - r[0][0] - r[2][2]);
+        _q[0] = (r[0][2] - r[2][0]) / s;
+        _q[1] = (r[0][1] + r[1][0]) / s;
+        _q[2] = 0.25f * s;
+        _q[3] = (r[1][2] + r[2][1]) / s;
+    } else {
+        s = 2.0f * sqrt(1.0f + r[2][2] - r[0][0] - r[1][1]);
+        _q[0] = (r[1][0] - r[0][1]) / s;
+        _q[1] = (r[0][2] + r[2][0]) / s;
+        _q[2] = (r[1][2] + r[2][1]) / s;
+        _q[3] = 0.25f * s;
+    }
+    _started = true;
+    return true;
+}
+
+/**
+	COMPENSATE
+	Madgwick's gyro bias drift compensation: the correction step s (normalized), seen as an
+	angular rate in the sensor frame, is the gyro error. Its integral times zeta is the bias,
+	which is taken off the gyro rates that qDot was calculated from.
+	
+	@since v1.3.0
+**/
+void QMC5883LFusion::_compensate(const float *s, float *qDot, float gx, float gy, float gz, float dt){
+    if ( _zeta == 0. ) return;
+    float q0 = _q[0];
+    float q1 = _q[1];
+    float q2 = _q[2];
+    float q3 = _q[3];
+    _bias[0] += 2.0f * (q0 * s[1] - q1 * s[0] - q2 * s[3] + q3 * s[2]) * dt * _zeta;
+    _bias[1] += 2.0f * (q0 * s[2] + q1 * s[3] - q2 * s[0] - q3 * s[1]) * dt * _zeta;
+    _bias[2] += 2.0f * (q0 * s[3] - q1 * s[2] + q2 * s[1] - q3 * s[0]) * dt * _zeta;
+    gx -= _bias[0];
+    gy -= _bias[1];
+    gz -= _bias[2];
+    qDot[0] = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+    qDot[1] = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+    qDot[2] = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+    qDot[3] = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+}
+
+/**
+	INTEGRATE
+	Advance the quaternion by its rate of change and normalize it.
+	
+	@since v1.3.0
+**/
+void QMC5883LFusion::_integrate(float *qDot, float dt){
+    float norm = 0;
+    for ( int i = 0; i < 4; i++ ) {
+        _q[i] += qDot[i] * dt;
+        norm += _q[i] * _q[i];
+    }
+    norm = 1. / sqrt(norm);
+    for ( int i = 0; i < 4; i++ ) _q[i] *= norm;
+}
+
+/**
+	GET QUATERNION
+	Orientation of the sensor in the earth frame as w, x, y, z.
+	
+	@since v1.3.0
+**/
+void QMC5883LFusion::getQuaternion(float *q){
+    for ( int i = 0; i < 4; i++ ) q[i] = _q[i];
+}
+
+/**
+	GET YAW
+	Rotation around the earth's Z (up) axis, counterclockwise seen from above.
+	
+	@since v1.3.0
+	@return float yaw in degrees, -180 to 180
+**/
+float QMC5883LFusion::getYaw(){
+    return atan2(_q[1] * _q[2] + _q[0] * _q[3], 0.5f - _q[2] * _q[2] - _q[3] * _q[3]) * 180.0 / PI;
+}
+
+/**
+	GET PITCH
+	Rotation around the sensor's Y axis.
+	
+	@since v1.3.0
+	@return float pitch in degrees, -90 to 90
+**/
+float QMC5883LFusion::getPitch(){
+    float s = -2.0f * (_q[1] * _q[3] - _q[0] * _q[2]);
+    if ( s > 1. ) s = 1.;
+    if ( s < -1. ) s = -1.;
+    return asin(s) * 180.0 / PI;
+}
+
+/**
+	GET ROLL
+	Rotation around the sensor's X axis.
+	
+	@since v1.3.0
+	@return float roll in degrees, -180 to 180
+**/
+float QMC5883LFusion::getRoll(){
+    return atan2(_q[0] * _q[1] + _q[2] * _q[3], 0.5f - _q[1] * _q[1] - _q[2] * _q[2]) * 180.0 / PI;
+}
+
+/**
+	GET HEADING
+	The yaw as a compass heading, in the same direction as QMC5883LCompass::getAzimuth() when
+	the sensor is level. The magnetic declination is not applied.
+	
+	@since v1.3.0
+	@return float heading in degrees, 0 to 360
+**/
+float QMC5883LFusion::getHeading(){
+    float heading = -getYaw();
+    return ( heading < 0 ) ? heading + 360. : heading;
+}
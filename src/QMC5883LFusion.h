@@ -0,0 +1,47 @@
+#ifndef QMC5883L_Fusion
+#define QMC5883L_Fusion
+
+#include "QMC5883LPlatform.h"
+#include "QMC5883LCompass.h"
+
+/**
+	Orientation fusion (Madgwick's gradient descent AHRS) of the compass with a gyroscope and an
+	accelerometer. Call update() for every gyro sample; the heading follows turns at the gyro
+	rate while the magnetometer and accelerometer slowly pull out the gyro drift.
+	
+	All three sensors must share the same axes. The earth frame has X pointing to magnetic North
+	and Z up, so the accelerometer must read a positive Z value when lying flat.
+
+	The first update() with an accelerometer and a field sample sets the orientation from them
+	directly, so the filter does not have to turn there from level and North at the rate beta
+	allows, which takes minutes for a large angle. The filter also learns the constant error
+	(bias) of the gyro, @see setZeta().
+**/
+class QMC5883LFusion{
+
+public:
+    QMC5883LFusion();
+    void setBeta(float beta);
+    void setZeta(float zeta);
+    void reset();
+    void update(float gx, float gy, float gz, float ax, float ay, float az, float mx, float my, float mz, float dt);
+    void update(QMC5883LCompass &compass, float gx, float gy, float gz, float ax, float ay, float az, float dt);
+    void updateIMU(float gx, float gy, float gz, float ax, float ay, float az, float dt);
+    void getQuaternion(float *q);
+    float getYaw();
+    float getPitch();
+    float getRoll();
+    float getHeading();
+
+private:
+    void _integrate(float *qDot, float dt);
+    bool _start(float ax, float ay, float az, float mx, float my, float mz);
+    void _compensate(const float *s, float *qDot, float gx, float gy, float gz, float dt);
+    float _beta = 0.1;
+    float _zeta = 0.005;
+    float _bias[3] = {0., 0., 0.};
+    float _q[4] = {1., 0., 0., 0.};
+    bool _started = false;
+};
+
+#endif
@@ -0,0 +1,320 @@
+/*
+===============================================================================================================
+QMC5883LGradiometer.h
+Magnetic gradiometer made of two sensors for the QMC5883L Compass library.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LGradiometer.h"
+
+QMC5883LGradiometer::QMC5883LGradiometer() {
+    clearCrossCalibration();
+}
+
+/**
+	INIT
+	Use two compasses that are initialized already, with the same data rate set with setMode().
+	The gradient is the second sensor minus the first one.
+
+	@since v1.3.0
+**/
+void QMC5883LGradiometer::init(QMC5883LCompass *first, QMC5883LCompass *second){
+    _sensor[0] = first;
+    _sensor[1] = second;
+    for ( byte s = 0; s < 2; s++ ) {
+        _count[s] = 0;
+        _fresh[s] = false;
+    }
+}
+
+/**
+	SET BASELINE
+	Distance between the two sensors, for @see getGradient().
+
+	@since v1.3.0
+	@param meters distance in meters, 1 by default
+**/
+void QMC5883LGradiometer::setBaseline(float meters){
+    _baseline = ( meters > 0 ) ? meters : 1.0;
+}
+
+/**
+	UPDATE
+	Read whichever sensor has a new sample (@see QMC5883LCompass::isDataReady()), and once
+	both have one, calculate the gradient. The sensors do not measure at exactly the same
+	moment. The one that measured later is interpolated back to the time of the other, from
+	its previous and current sample. Call this as often as possible, it returns true once for
+	every pair of samples, so at the data rate of the sensors.
+
+	@since v1.3.0
+	@return bool true when there is a new gradient
+**/
+bool QMC5883LGradiometer::update(){
+    if ( !_sensor[0] || !_sensor[1] ) return false;
+
+    for ( byte s = 0; s < 2; s++ ) {
+        if ( !_fresh[s] ) _fresh[s] = _poll(s);
+    }
+    if ( !_fresh[0] || !_fresh[1] ) return false;
+    _fresh[0] = false;
+    _fresh[1] = false;
+
+    byte early = ( (long)(_time[1][1] - _time[0][1]) >= 0 ) ? 0 : 1;
+    byte late = 1 - early;
+    unsigned long t = _time[early][1];
+
+    float v[2][3];
+    long span = (long)(_time[late][1] - _time[late][0]);
+    long part = (long)(t - _time[late][0]);
+    bool interpolate = _count[late] > 1 && span > 0 && part >= 0 && part <= span;
+    for ( byte i = 0; i < 3; i++ ) {
+        v[early][i] = _value[early][1][i];
+        v[late][i] = _value[late][1][i];
+        if ( interpolate ) {
+            v[late][i] = _value[late][0][i] + (float)(_value[late][1][i] - _value[late][0][i]) * part / span;
+        }
+    }
+
+    if ( _calibrating ) {
+        _accumulate(v[0], v[1]);
+    }
+
+    for ( byte i = 0; i < 3; i++ ) {
+        float g = v[1][i] - (_matrix[i][0] * v[0][0] + _matrix[i][1] * v[0][1] + _matrix[i][2] * v[0][2] + _offset[i]);
+        if ( g > 32767. ) g = 32767.;
+        if ( g < -32768. ) g = -32768.;
+        _gradient[i] = (int16_t)round(g);
+    }
+    _timestamp = t;
+    return true;
+}
+
+/**
+	GET X, Y, Z
+	Difference between the second sensor and the first one, in sensor units, @see update().
+
+	@since v1.3.0
+	@return int gradient axis value
+**/
+int QMC5883LGradiometer::getX(){
+    return _gradient[0];
+}
+
+int QMC5883LGradiometer::getY(){
+    return _gradient[1];
+}
+
+int QMC5883LGradiometer::getZ(){
+    return _gradient[2];
+}
+
+/**
+	GET STRENGTH
+	Length of the difference, sqrt(x^2 + y^2 + z^2), a single number to compare with a
+	detection threshold.
+
+	@since v1.3.0
+	@return unsigned int strength in sensor units
+**/
+unsigned int QMC5883LGradiometer::getStrength(){
+    float x = _gradient[0];
+    float y = _gradient[1];
+    float z = _gradient[2];
+    return (unsigned int)round(sqrt(x * x + y * y + z * z));
+}
+
+/**
+	GET GRADIENT
+	One axis of the difference divided by the baseline, @see setBaseline().
+
+	@since v1.3.0
+	@param index 0 - 2 for X, Y, Z
+	@return float gradient in sensor units per meter
+**/
+float QMC5883LGradiometer::getGradient(uint8_t index){
+    return _gradient[index] / _baseline;
+}
+
+/**
+	GET TIMESTAMP
+	micros() right after the first of the two samples of the latest gradient was read.
+
+	@since v1.3.0
+**/
+unsigned long QMC5883LGradiometer::getTimestamp(){
+    return _timestamp;
+}
+
+/**
+	START CROSS CALIBRATION
+	Start collecting samples for the cross calibration. While it runs, call update() as usual
+	and turn the pair slowly in all directions, as with a calibration, in a place without
+	nearby iron. Then call @see finishCrossCalibration().
+
+	@since v1.3.0
+**/
+void QMC5883LGradiometer::startCrossCalibration(){
+    _samples = 0;
+    for ( byte i = 0; i < 3; i++ ) {
+        _meanA[i] = 0;
+        _meanB[i] = 0;
+        for ( byte j = 0; j < 3; j++ ) {
+            _momentAA[i][j] = 0;
+            _momentBA[i][j] = 0;
+        }
+    }
+    _calibrating = true;
+}
+
+/**
+	GET CROSS CALIBRATION SAMPLES
+
+	@since v1.3.0
+	@return unsigned long samples collected since startCrossCalibration()
+**/
+unsigned long QMC5883LGradiometer::getCrossCalibrationSamples(){
+    return _samples;
+}
+
+/**
+	FINISH CROSS CALIBRATION
+	Fit M and c by least squares from the collected samples: M = Cov(B, A) * Cov(A, A)^-1
+	and c = mean(B) - M * mean(A).
+
+	@since v1.3.0
+	@return bool false if there are too few samples or the pair was not turned enough, in
+	        which case the previous cross calibration is kept
+**/
+bool QMC5883LGradiometer::finishCrossCalibration(){
+    _calibrating = false;
+    if ( _samples < 12 ) return false;
+
+    float c[3][3];
+    for ( byte i = 0; i < 3; i++ ) {
+        for ( byte j = 0; j < 3; j++ ) c[i][j] = _momentAA[i][j] / _samples;
+    }
+
+    // Inverse of the covariance from its adjugate.
+    float inverse[3][3];
+    for ( byte i = 0; i < 3; i++ ) {
+        for ( byte j = 0; j < 3; j++ ) {
+            byte i1 = (j + 1) % 3, i2 = (j + 2) % 3;
+            byte j1 = (i + 1) % 3, j2 = (i + 2) % 3;
+            inverse[i][j] = c[i1][j1] * c[i2][j2] - c[i1][j2] * c[i2][j1];
+        }
+    }
+    float det = c[0][0] * inverse[0][0] + c[0][1] * inverse[1][0] + c[0][2] * inverse[2][0];
+    float trace = (c[0][0] + c[1][1] + c[2][2]) / 3;
+
+    // All three directions must have been covered, not just a plane.
+    if ( trace <= 0 || det < 1e-3 * trace * trace * trace ) return false;
+
+    for ( byte i = 0; i < 3; i++ ) {
+        for ( byte j = 0; j < 3; j++ ) {
+            _matrix[i][j] = 0;
+            for ( byte k = 0; k < 3; k++ ) _matrix[i][j] += _momentBA[i][k] / _samples * inverse[k][j] / det;
+        }
+    }
+    for ( byte i = 0; i < 3; i++ ) {
+        _offset[i] = _meanB[i] - (_matrix[i][0] * _meanA[0] + _matrix[i][1] * _meanA[1] + _matrix[i][2] * _meanA[2]);
+    }
+    return true;
+}
+
+/**
+	SET CROSS CALIBRATION
+	Restore a cross calibration saved with @see getCrossCalibration().
+
+	@since v1.3.0
+	@param matrix 9 values, row by row
+	@param offset 3 values
+**/
+void QMC5883LGradiometer::setCrossCalibration(const float *matrix, const float *offset){
+    for ( byte i = 0; i < 3; i++ ) {
+        for ( byte j = 0; j < 3; j++ ) _matrix[i][j] = matrix[i * 3 + j];
+        _offset[i] = offset[i];
+    }
+}
+
+/**
+	GET CROSS CALIBRATION
+
+	@since v1.3.0
+	@param matrix receives 9 values, row by row
+	@param offset receives 3 values
+**/
+void QMC5883LGradiometer::getCrossCalibration(float *matrix, float *offset){
+    for ( byte i = 0; i < 3; i++ ) {
+        for ( byte j = 0; j < 3; j++ ) matrix[i * 3 + j] = _matrix[i][j];
+        offset[i] = _offset[i];
+    }
+}
+
+/**
+	CLEAR CROSS CALIBRATION
+	Use the plain difference B - A.
+
+	@since v1.3.0
+**/
+void QMC5883LGradiometer::clearCrossCalibration(){
+    for ( byte i = 0; i < 3; i++ ) {
+        for ( byte j = 0; j < 3; j++ ) _matrix[i][j] = ( i == j ) ? 1.0 : 0.0;
+        _offset[i] = 0;
+    }
+}
+
+/**
+	POLL
+	Read a sensor if it has a new sample, keeping the previous one for the interpolation.
+	The sample is timed right after its own read, so the time one read takes on the bus does
+	not end up in the difference between the two sensors.
+
+	@since v1.3.0
+	@return bool true if a new sample was read
+**/
+bool QMC5883LGradiometer::_poll(byte s){
+    QMC5883LCompass *sensor = _sensor[s];
+    if ( !sensor->isDataReady() ) return false;
+    sensor->read();
+    unsigned long now = micros();
+    if ( sensor->getReadErrors() > 0 ) return false;
+
+    for ( byte i = 0; i < 3; i++ ) _value[s][0][i] = _value[s][1][i];
+    _time[s][0] = _time[s][1];
+    _value[s][1][0] = sensor->getX();
+    _value[s][1][1] = sensor->getY();
+    _value[s][1][2] = sensor->getZ();
+    _time[s][1] = now;
+    if ( _count[s] < 2 ) _count[s]++;
+    return true;
+}
+
+/**
+	ACCUMULATE
+	Add a pair of samples to the running means and co-moments of the cross calibration.
+
+	@since v1.3.0
+**/
+void QMC5883LGradiometer::_accumulate(const float *a, const float *b){
+    _samples++;
+    float da[3];
+    float db[3];
+    for ( byte i = 0; i < 3; i++ ) {
+        da[i] = a[i] - _meanA[i];
+        db[i] = b[i] - _meanB[i];
+        _meanA[i] += da[i] / _samples;
+        _meanB[i] += db[i] / _samples;
+    }
+    for ( byte i = 0; i < 3; i++ ) {
+        for ( byte j = 0; j < 3; j++ ) {
+            float after = a[j] - _meanA[j];
+            _momentAA[i][j] += da[i] * after;
+            _momentBA[i][j] += db[i] * after;
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef QMC5883L_Gradiometer
+#define QMC5883L_Gradiometer
+
+#include "QMC5883LPlatform.h"
+#include "QMC5883LCompass.h"
+
+/**
+	Magnetic gradiometer made of two compasses mounted a known distance apart, with the same
+	orientation. The earth's field is the same at both sensors and cancels out in the
+	difference. A nearby ferrous object or magnet is much closer to one sensor than to the other
+	and shows up in it. Used for vehicle detection and finding buried objects.
+
+	Two sensors never read exactly the same, even after calibrating each of them. The second
+	sensor is therefore modelled from the first, B = M * A + c, with a 3x3 matrix M and an offset
+	c fitted by a cross calibration. The gradient is what is left, B - (M * A + c).
+
+	@since v1.3.0
+**/
+class QMC5883LGradiometer{
+
+public:
+    QMC5883LGradiometer();
+    void init(QMC5883LCompass *first, QMC5883LCompass *second);
+    void setBaseline(float meters);
+    bool update();
+    int getX();
+    int getY();
+    int getZ();
+    unsigned int getStrength();
+    float getGradient(uint8_t index);
+    unsigned long getTimestamp();
+    void startCrossCalibration();
+    unsigned long getCrossCalibrationSamples();
+    bool finishCrossCalibration();
+    void setCrossCalibration(const float *matrix, const float *offset);
+    void getCrossCalibration(float *matrix, float *offset);
+    void clearCrossCalibration();
+
+private:
+    bool _poll(byte sensor);
+    void _accumulate(const float *a, const float *b);
+
+    QMC5883LCompass *_sensor[2] = {nullptr, nullptr};
+    float _matrix[3][3];
+    float _offset[3];
+    float _baseline = 1.0;
+
+    // Cross calibration sums: means and co-moments of the samples (Welford).
+    unsigned long _samples = 0;
+    float _meanA[3];
+    float _meanB[3];
+    float _momentAA[3][3];
+    float _momentBA[3][3];
+
+    unsigned long _time[2][2];
+    unsigned long _timestamp = 0;
+    int16_t _value[2][2][3];
+    int16_t _gradient[3] = {0, 0, 0};
+    byte _count[2] = {0, 0};
+    bool _fresh[2] = {false, false};
+    bool _calibrating = false;
+};
+
+#endif
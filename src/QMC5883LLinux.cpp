@@ -0,0 +1,230 @@
+/*
+===============================================================================================================
+QMC5883LLinux.h
+Linux i2c-dev backend for the QMC5883L Compass library.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LPlatform.h"
+
+#ifdef QMC5883L_LINUX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <atomic>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+TwoWire Wire;
+
+static int QMC5883L_ioctl(int fd, unsigned long request, void *argument) {
+    return ioctl(fd, request, argument);
+}
+
+static uint64_t QMC5883L_nanoseconds() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Like on a board, the time counts from the start of the program.
+static const uint64_t QMC5883L_START = QMC5883L_nanoseconds();
+
+// The clock set with setMicros(), nullptr for the real one.
+static std::atomic<unsigned long (*)()> QMC5883L_micros{nullptr};
+
+unsigned long millis() {
+    unsigned long (*clock)() = QMC5883L_micros.load(std::memory_order_relaxed);
+    if ( clock ) return clock() / 1000;
+    return (unsigned long)((QMC5883L_nanoseconds() - QMC5883L_START) / 1000000ULL);
+}
+
+unsigned long micros() {
+    unsigned long (*clock)() = QMC5883L_micros.load(std::memory_order_relaxed);
+    if ( clock ) return clock();
+    return (unsigned long)((QMC5883L_nanoseconds() - QMC5883L_START) / 1000ULL);
+}
+
+/**
+	SET MICROS
+	Let micros() and millis() return the time of another clock, e.g. the recorded time of a log
+	that is replayed. delay() and delayMicroseconds() still wait in real time.
+
+	@since v1.3.0
+	@param microsFunction the clock in microseconds, nullptr for the real one
+**/
+void setMicros(unsigned long (*microsFunction)()) {
+    QMC5883L_micros.store(microsFunction, std::memory_order_relaxed);
+}
+
+void delay(unsigned long ms) {
+    struct timespec wait = { (time_t)(ms / 1000), (long)(ms % 1000) * 1000000L };
+    while ( nanosleep(&wait, &wait) != 0 && errno == EINTR ) {}
+}
+
+void delayMicroseconds(unsigned int us) {
+    struct timespec wait = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000L };
+    while ( nanosleep(&wait, &wait) != 0 && errno == EINTR ) {}
+}
+
+/**
+	@param device path of the bus, e.g. /dev/i2c-1. It is opened by begin().
+**/
+TwoWire::TwoWire(const char *device)
+    : _device(device),
+      _ioctl(QMC5883L_ioctl) {
+}
+
+TwoWire::~TwoWire() {
+    end();
+}
+
+/**
+	BEGIN
+	Open the bus device. Calling it again while open does nothing.
+
+	@since v1.3.0
+**/
+void TwoWire::begin() {
+    if ( _fd < 0 ) {
+        _fd = open(_device, O_RDWR);
+    }
+}
+
+/**
+	END
+	Close the bus device.
+
+	@since v1.3.0
+**/
+void TwoWire::end() {
+    if ( _fd >= 0 ) {
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+/**
+	SET CLOCK
+	The bus speed is set by the kernel (dtparam=i2c_arm_baudrate on a Raspberry Pi), so this
+	does nothing.
+
+	@since v1.3.0
+**/
+void TwoWire::setClock(uint32_t) {
+}
+
+/**
+	SET IOCTL
+	Replace the ioctl() system call, e.g. with a simulated device for testing without hardware.
+	The function receives I2C_RDWR requests with a struct i2c_rdwr_ioctl_data.
+
+	@since v1.3.0
+**/
+void TwoWire::setIoctl(int (*ioctlFunction)(int fd, unsigned long request, void *argument)) {
+    _ioctl = ioctlFunction ? ioctlFunction : QMC5883L_ioctl;
+}
+
+void TwoWire::beginTransmission(uint8_t address) {
+    _address = address;
+    _txLength = 0;
+    _pending = false;
+}
+
+size_t TwoWire::write(uint8_t data) {
+    if ( _txLength >= QMC5883L_LINUX_BUFFER ) return 0;
+    _tx[_txLength++] = data;
+    return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t length) {
+    size_t written = 0;
+    while ( written < length && write(data[written]) ) written++;
+    return written;
+}
+
+/**
+	END TRANSMISSION
+	Send the bytes written since beginTransmission(). Without a stop they are kept and sent
+	together with the next requestFrom() as one combined transaction.
+
+	@since v1.3.0
+	@return uint8_t 0 on success, 2 if the device did not answer, 4 for other errors, like
+	        the Arduino Wire library
+**/
+uint8_t TwoWire::endTransmission(bool sendStop) {
+    if ( !sendStop ) {
+        _pending = true;
+        return 0;
+    }
+
+    i2c_msg message = { _address, 0, _txLength, _tx };
+    _txLength = 0;
+    return _transfer(&message, 1);
+}
+
+/**
+	REQUEST FROM
+	Read bytes from a device, preceded by the write left pending by endTransmission(false).
+
+	@since v1.3.0
+	@return uint8_t number of bytes read, 0 on error
+**/
+uint8_t TwoWire::requestFrom(uint8_t address, uint8_t quantity, bool) {
+    _rxLength = 0;
+    _rxIndex = 0;
+    if ( quantity > QMC5883L_LINUX_BUFFER ) quantity = QMC5883L_LINUX_BUFFER;
+
+    i2c_msg messages[2];
+    int count = 0;
+    if ( _pending ) {
+        _pending = false;
+        if ( _address != address ) {
+            if ( endTransmission() != 0 ) return 0;
+        } else {
+            messages[count++] = { _address, 0, _txLength, _tx };
+        }
+        _txLength = 0;
+    }
+    messages[count++] = { address, I2C_M_RD, quantity, _rx };
+
+    if ( _transfer(messages, count) != 0 ) return 0;
+    _rxLength = quantity;
+    return quantity;
+}
+
+int TwoWire::available() {
+    return _rxLength - _rxIndex;
+}
+
+int TwoWire::read() {
+    if ( _rxIndex >= _rxLength ) return -1;
+    return _rx[_rxIndex++];
+}
+
+/**
+	TRANSFER
+	Run messages as one I2C_RDWR transaction, with repeated starts between them.
+
+	@since v1.3.0
+	@return uint8_t Arduino Wire error code
+**/
+uint8_t TwoWire::_transfer(i2c_msg *messages, int count) {
+    if ( _fd < 0 ) return 4;
+
+    i2c_rdwr_ioctl_data transaction = { messages, (uint32_t)count };
+    if ( _ioctl(_fd, I2C_RDWR, &transaction) < 0 ) {
+        return ( errno == ENXIO || errno == EREMOTEIO || errno == EIO ) ? 2 : 4;
+    }
+    return 0;
+}
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef QMC5883L_Linux
+#define QMC5883L_Linux
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+	LINUX BACKEND
+	The parts of the Arduino core the library uses, for Linux single board computers (Raspberry
+	Pi, BeagleBone, ...) and for running the library on a PC. TwoWire has the same functions as
+	the Arduino Wire library and talks to /dev/i2c-N through the i2c-dev kernel driver, so the
+	rest of the library is the same code on a microcontroller and on Linux.
+
+	A register write followed by a read, with endTransmission(false) in between, is sent as one
+	combined I2C_RDWR transaction with a repeated start, like on Arduino. Only then are errors
+	of the write reported, by requestFrom() returning 0.
+
+	Example:
+
+	TwoWire bus("/dev/i2c-1");
+	QMC5883LCompass compass;
+
+	compass.init(&bus);
+	compass.read();
+
+	@since v1.3.0
+**/
+
+typedef uint8_t byte;
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+
+unsigned long millis();
+unsigned long micros();
+void setMicros(unsigned long (*microsFunction)());
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+struct i2c_msg;
+
+// Largest transfer in one direction, the same as the Arduino AVR Wire buffer.
+#define QMC5883L_LINUX_BUFFER 32
+
+class TwoWire{
+
+public:
+    TwoWire(const char *device = "/dev/i2c-1");
+    ~TwoWire();
+    void begin();
+    void end();
+    void setClock(uint32_t frequency);
+    void setIoctl(int (*ioctlFunction)(int fd, unsigned long request, void *argument));
+    void beginTransmission(uint8_t address);
+    size_t write(uint8_t data);
+    size_t write(const uint8_t *data, size_t length);
+    uint8_t endTransmission(bool sendStop = true);
+    uint8_t requestFrom(uint8_t address, uint8_t quantity, bool sendStop = true);
+    int available();
+    int read();
+
+private:
+    uint8_t _transfer(i2c_msg *messages, int count);
+
+    const char *_device;
+    int (*_ioctl)(int fd, unsigned long request, void *argument);
+    int _fd = -1;
+    uint8_t _address = 0;
+    uint8_t _tx[QMC5883L_LINUX_BUFFER];
+    uint8_t _rx[QMC5883L_LINUX_BUFFER];
+    uint8_t _txLength = 0;
+    uint8_t _rxLength = 0;
+    uint8_t _rxIndex = 0;
+    bool _pending = false;
+};
+
+// The default bus, /dev/i2c-1 as on a Raspberry Pi.
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef QMC5883L_Lock
+#define QMC5883L_Lock
+
+#include "QMC5883LPlatform.h"
+
+/*
+	Bus locking for sketches and programs that use the library from several threads or RTOS
+	tasks. Without it, two tasks talking to the same bus at once mix up their transactions.
+	The policy is chosen at compile time, e.g. with build_flags in PlatformIO or -D on Linux:
+
+	QMC5883L_LOCK_STD       a std::recursive_mutex, for Linux and other hosts
+	QMC5883L_LOCK_FREERTOS  a FreeRTOS recursive mutex, for the ESP32 and other FreeRTOS boards
+
+	or define QMC5883L_LOCK(bus) and QMC5883L_UNLOCK(bus) to use your own lock, e.g. the one
+	another library already uses for the same bus. With none of these the lock compiles to
+	nothing. The built in policies use a single lock for all buses.
+*/
+#if defined(QMC5883L_LOCK_STD)
+#include <mutex>
+
+inline std::recursive_mutex &QMC5883L_mutex() {
+    static std::recursive_mutex mutex;
+    return mutex;
+}
+
+#define QMC5883L_LOCK(bus) QMC5883L_mutex().lock()
+#define QMC5883L_UNLOCK(bus) QMC5883L_mutex().unlock()
+
+#elif defined(QMC5883L_LOCK_FREERTOS)
+#if defined(ESP_PLATFORM) || defined(ESP32)
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#else
+#include "FreeRTOS.h"
+#include "semphr.h"
+#endif
+
+inline SemaphoreHandle_t QMC5883L_mutex() {
+    static SemaphoreHandle_t mutex = xSemaphoreCreateRecursiveMutex();
+    return mutex;
+}
+
+#define QMC5883L_LOCK(bus) xSemaphoreTakeRecursive(QMC5883L_mutex(), portMAX_DELAY)
+#define QMC5883L_UNLOCK(bus) xSemaphoreGiveRecursive(QMC5883L_mutex())
+
+#elif !defined(QMC5883L_LOCK)
+#define QMC5883L_LOCK(bus) ((void)(bus))
+#define QMC5883L_UNLOCK(bus) ((void)(bus))
+#endif
+
+// Memory barrier between the sample counter and the sample values, @see QMC5883LCompass::getSample().
+#ifndef QMC5883L_BARRIER
+#define QMC5883L_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/**
+	BUS LOCK
+	Holds the lock of a bus for as long as it exists. The lock is recursive, so a lock held
+	around a compass read can also cover the multiplexer switch inside it.
+
+	Example:
+
+	{
+	  QMC5883LLock lock(&Wire);
+	  mux.select(2);
+	  compass.read();
+	}
+
+	@since v1.3.0
+**/
+class QMC5883LLock {
+public:
+    explicit QMC5883LLock(TwoWire *bus) : _bus(bus) {
+        QMC5883L_LOCK(_bus);
+    }
+
+    ~QMC5883LLock() {
+        QMC5883L_UNLOCK(_bus);
+    }
+
+private:
+    QMC5883LLock(const QMC5883LLock &);
+    QMC5883LLock &operator=(const QMC5883LLock &);
+
+    TwoWire *_bus;
+};
+
+#endif
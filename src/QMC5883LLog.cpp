@@ -0,0 +1,407 @@
+/*
+===============================================================================================================
+QMC5883LLog.h
+Binary sample log with a writer, a memory mapped reader and a replay bus for the QMC5883L Compass library.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LLog.h"
+
+static const uint8_t QMC5883L_LOG_MAGIC[4] = {'Q', 'M', 'C', 'L'};
+
+/**
+	BEGIN
+	Start a log. Every block is handed to the write function in pieces as the samples come in,
+	which returns how many bytes it took, like write() of a File.
+
+	@since v1.3.0
+	@param context passed on to the write function, e.g. the file
+**/
+void QMC5883LLogWriter::begin(size_t (*write)(const uint8_t *data, size_t length, void *context), void *context) {
+    _writer = write;
+    _context = context;
+    _records = 0;
+    _errors = 0;
+    _block = 0;
+    _count = 0;
+}
+
+/**
+	READ
+	@see QMC5883LCompass::read(), logging the sample it read, or its failure.
+
+	@since v1.3.0
+	@return bool true if auto calibration found a new minimum or maximum, like read()
+**/
+bool QMC5883LLogWriter::read(QMC5883LCompass *compass) {
+    QMC5883LLock lock(compass->wire);
+    QMC5883LRawSample raw;
+    bool ok = compass->readRaw(&raw);
+    add(compass, &raw, ok);
+    if ( ok ) {
+        return compass->process(&raw);
+    }
+    compass->_readFailed();
+    return false;
+}
+
+/**
+	ADD
+	Log a sample from @see QMC5883LCompass::readRaw(), with the settings of the compass it came
+	from.
+
+	@since v1.3.0
+	@param ok what readRaw() returned
+**/
+void QMC5883LLogWriter::add(QMC5883LCompass *compass, const QMC5883LRawSample *raw, bool ok) {
+    if ( !_writer ) return;
+
+    if ( _count == 0 ) {
+        uint8_t header[QMC5883L_LOG_HEADER] = {
+            QMC5883L_LOG_MAGIC[0], QMC5883L_LOG_MAGIC[1], QMC5883L_LOG_MAGIC[2], QMC5883L_LOG_MAGIC[3],
+            QMC5883L_LOG_VERSION, QMC5883L_LOG_RECORD, (uint8_t)_block, (uint8_t)(_block >> 8)
+        };
+        _sum1 = 0;
+        _sum2 = 0;
+        _write(header, sizeof(header));
+    }
+
+    uint32_t timestamp = raw->timestamp;
+    int16_t x = ok ? raw->x : 0;
+    int16_t y = ok ? raw->y : 0;
+    int16_t z = ok ? raw->z : 0;
+    int16_t temperature = ok ? raw->temperature : INT16_MIN;
+    uint8_t record[QMC5883L_LOG_RECORD] = {
+        (uint8_t)timestamp, (uint8_t)(timestamp >> 8), (uint8_t)(timestamp >> 16), (uint8_t)(timestamp >> 24),
+        (uint8_t)x, (uint8_t)((uint16_t)x >> 8),
+        (uint8_t)y, (uint8_t)((uint16_t)y >> 8),
+        (uint8_t)z, (uint8_t)((uint16_t)z >> 8),
+        (uint8_t)temperature, (uint8_t)((uint16_t)temperature >> 8),
+        (uint8_t)(ok ? raw->status : 0),
+        (uint8_t)(ok ? 0 : QMC5883L_LOG_FAILED),
+        compass->_control,
+        0
+    };
+    _write(record, sizeof(record));
+    _records++;
+
+    if ( ++_count == QMC5883L_LOG_RECORDS ) {
+        _endBlock();
+    }
+}
+
+/**
+	END
+	Finish the current block, filling it up with empty records. Call it before closing the
+	file. Samples added afterwards start a new block.
+
+	@since v1.3.0
+**/
+void QMC5883LLogWriter::end() {
+    if ( _writer && _count > 0 ) {
+        _endBlock();
+    }
+}
+
+/**
+	GET RECORDS
+	@since v1.3.0
+	@return unsigned long samples logged since begin()
+**/
+unsigned long QMC5883LLogWriter::getRecords() {
+    return _records;
+}
+
+/**
+	GET ERRORS
+	Number of times the write function took fewer bytes than it was given. The block it
+	happened in fails its checksum when the log is read.
+
+	@since v1.3.0
+**/
+unsigned long QMC5883LLogWriter::getErrors() {
+    return _errors;
+}
+
+/**
+	WRITE
+	Pass bytes on and add them to the Fletcher-16 checksum of the block.
+
+	@since v1.3.0
+**/
+void QMC5883LLogWriter::_write(const uint8_t *data, size_t length) {
+    for ( size_t i = 0; i < length; i++ ) {
+        _sum1 += data[i];
+        if ( _sum1 >= 255 ) _sum1 -= 255;
+        _sum2 += _sum1;
+        if ( _sum2 >= 255 ) _sum2 -= 255;
+    }
+    if ( _writer(data, length, _context) != length ) {
+        _errors++;
+    }
+}
+
+/**
+	END BLOCK
+	Fill the block up with empty records and write its trailer.
+
+	@since v1.3.0
+**/
+void QMC5883LLogWriter::_endBlock() {
+    uint8_t empty[QMC5883L_LOG_RECORD] = {0};
+    for ( byte i = _count; i < QMC5883L_LOG_RECORDS; i++ ) {
+        _write(empty, sizeof(empty));
+    }
+    uint8_t trailer[8] = { _count, 0, 0, 0, 0, 0, (uint8_t)_sum1, (uint8_t)_sum2 };
+    if ( _writer(trailer, sizeof(trailer), _context) != sizeof(trailer) ) {
+        _errors++;
+    }
+    _count = 0;
+    _block++;
+}
+
+#ifdef QMC5883L_LINUX
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+
+// The replay the bus talks to, @see QMC5883LLogReplay::_ioctl().
+static QMC5883LLogReplay *QMC5883L_replay = nullptr;
+
+QMC5883LLogReader::~QMC5883LLogReader() {
+    close();
+}
+
+/**
+	OPEN
+	Map a log into memory, read only. A block cut short at the end is left out.
+
+	@since v1.3.0
+	@return bool false if the file can not be mapped or is not a log
+**/
+bool QMC5883LLogReader::open(const char *path) {
+    close();
+    int file = ::open(path, O_RDONLY);
+    if ( file < 0 ) return false;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if ( fstat(file, &info) == 0 && info.st_size >= QMC5883L_LOG_BLOCK ) {
+        data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    }
+    ::close(file);
+    if ( data == MAP_FAILED ) return false;
+
+    if ( !isLog(data, (size_t)info.st_size) ) {
+        munmap(data, (size_t)info.st_size);
+        return false;
+    }
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+    _data = (const uint8_t *)data;
+    _size = (size_t)info.st_size;
+    return true;
+}
+
+void QMC5883LLogReader::close() {
+    if ( _data ) {
+        munmap((void *)_data, _size);
+        _data = nullptr;
+        _size = 0;
+    }
+}
+
+size_t QMC5883LLogReader::getBlocks() {
+    return _size / QMC5883L_LOG_BLOCK;
+}
+
+/**
+	GET RECORDS
+	The records of a block, where they are in the file.
+
+	@since v1.3.0
+	@param count receives the number of records used
+	@return const QMC5883LLogRecord* nullptr if the block is damaged
+**/
+const QMC5883LLogRecord *QMC5883LLogReader::getRecords(size_t block, byte *count) {
+    *count = 0;
+    if ( block >= getBlocks() ) return nullptr;
+    const uint8_t *data = _data + block * QMC5883L_LOG_BLOCK;
+    if ( !isLog(data, QMC5883L_LOG_BLOCK) ) return nullptr;
+
+    const uint8_t *trailer = data + QMC5883L_LOG_HEADER + QMC5883L_LOG_RECORDS * QMC5883L_LOG_RECORD;
+    uint16_t sum1 = 0;
+    uint16_t sum2 = 0;
+    for ( const uint8_t *p = data; p < trailer; p++ ) {
+        sum1 = (sum1 + *p) % 255;
+        sum2 = (sum2 + sum1) % 255;
+    }
+    if ( trailer[0] > QMC5883L_LOG_RECORDS || trailer[6] != sum1 || trailer[7] != sum2 ) return nullptr;
+
+    *count = trailer[0];
+    return (const QMC5883LLogRecord *)(data + QMC5883L_LOG_HEADER);
+}
+
+/**
+	IS LOG
+	@since v1.3.0
+	@return bool true if the data starts with a block header of this version
+**/
+bool QMC5883LLogReader::isLog(const void *data, size_t size) {
+    const uint8_t *header = (const uint8_t *)data;
+    return size >= QMC5883L_LOG_BLOCK && memcmp(header, QMC5883L_LOG_MAGIC, 4) == 0
+        && header[4] == QMC5883L_LOG_VERSION && header[5] == QMC5883L_LOG_RECORD;
+}
+
+QMC5883LLogReplay::~QMC5883LLogReplay() {
+    end();
+}
+
+/**
+	BEGIN
+	Replay a log, from the start, on a bus that is not opened yet.
+
+	@since v1.3.0
+**/
+void QMC5883LLogReplay::begin(QMC5883LLogReader *log, TwoWire *bus) {
+    end();
+    _log = log;
+    _bus = bus;
+    _records = nullptr;
+    _block = 0;
+    _index = 0;
+    _count = 0;
+    _replayed = 0;
+    const QMC5883LLogRecord *first = _peek();
+    _time = first ? first->timestamp : 0;
+    QMC5883L_replay = this;
+    _bus->setIoctl(_ioctl);
+    setMicros(_micros);
+}
+
+/**
+	END
+	Give the bus back to the real ioctl().
+
+	@since v1.3.0
+**/
+void QMC5883LLogReplay::end() {
+    if ( QMC5883L_replay == this ) {
+        QMC5883L_replay = nullptr;
+        setMicros(nullptr);
+    }
+    if ( _bus ) {
+        _bus->setIoctl(nullptr);
+        _bus = nullptr;
+    }
+}
+
+/**
+	AVAILABLE
+	@since v1.3.0
+	@return bool true while there are records left to replay
+**/
+bool QMC5883LLogReplay::available() {
+    return _peek() != nullptr;
+}
+
+/**
+	GET REPLAYED
+	@since v1.3.0
+	@return unsigned long records replayed, including failed reads
+**/
+unsigned long QMC5883LLogReplay::getReplayed() {
+    return _replayed;
+}
+
+/**
+	PEEK
+	The next record to replay, skipping damaged blocks.
+
+	@since v1.3.0
+	@return const QMC5883LLogRecord* nullptr at the end of the log
+**/
+const QMC5883LLogRecord *QMC5883LLogReplay::_peek() {
+    while ( _index >= _count ) {
+        if ( !_log || _block >= _log->getBlocks() ) return nullptr;
+        _records = _log->getRecords(_block++, &_count);
+        _index = 0;
+    }
+    return &_records[_index];
+}
+
+/**
+	MICROS
+	The clock while a log is replayed: the timestamp of the next record. The 32 bit timestamps
+	are added up as differences, so the time goes on across their wrap after 71 minutes like
+	micros() does on a 64 bit system.
+
+	@since v1.3.0
+**/
+unsigned long QMC5883LLogReplay::_micros() {
+    QMC5883LLogReplay *replay = QMC5883L_replay;
+    if ( !replay ) return 0;
+    const QMC5883LLogRecord *record = replay->_peek();
+    if ( record ) replay->_time += (uint32_t)(record->timestamp - (uint32_t)replay->_time);
+    return replay->_time;
+}
+
+/**
+	IOCTL
+	Answer the I2C_RDWR transactions of the bus like the chip: a read of the data registers
+	(0x00) returns the next record, a read of the status register (0x06) reports whether one is
+	ready. Writes are accepted and ignored.
+
+	@since v1.3.0
+**/
+int QMC5883LLogReplay::_ioctl(int, unsigned long request, void *argument) {
+    QMC5883LLogReplay *replay = QMC5883L_replay;
+    if ( request != I2C_RDWR || !replay ) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    i2c_rdwr_ioctl_data *transaction = (i2c_rdwr_ioctl_data *)argument;
+    i2c_msg *read = &transaction->msgs[transaction->nmsgs - 1];
+    if ( !(read->flags & I2C_M_RD) ) {
+        return (int)transaction->nmsgs;
+    }
+
+    const QMC5883LLogRecord *record = replay->_peek();
+    if ( !record ) {
+        errno = ENXIO;
+        return -1;
+    }
+
+    byte reg = ( transaction->nmsgs > 1 && transaction->msgs[0].len > 0 ) ? transaction->msgs[0].buf[0] : 0;
+    uint8_t data[9] = {0};
+    if ( reg == 0x00 ) {
+        replay->_index++;
+        replay->_replayed++;
+        if ( record->flags & QMC5883L_LOG_FAILED ) {
+            errno = EIO;
+            return -1;
+        }
+        memcpy(data, &record->x, 6);
+        data[6] = record->status;
+        memcpy(data + 7, &record->temperature, 2);
+    } else if ( reg == 0x06 ) {
+        data[0] = record->status | 0x01;
+    }
+
+    for ( uint16_t i = 0; i < read->len; i++ ) {
+        read->buf[i] = i < sizeof(data) ? data[i] : 0;
+    }
+    return (int)transaction->nmsgs;
+}
+
+#endif
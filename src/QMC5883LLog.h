@@ -0,0 +1,195 @@
+#ifndef QMC5883L_Log
+#define QMC5883L_Log
+
+#include "QMC5883LPlatform.h"
+#include "QMC5883LCompass.h"
+
+/*
+	LOG FORMAT
+	A log is a sequence of 512 byte blocks, the sector size of SD cards, so a block can be
+	written in one go and found again at a fixed position. All numbers are little endian.
+
+	offset  size  block
+	0       4     "QMCL"
+	4       1     version, 1
+	5       1     size of a record, 16
+	6       2     block number, counting up from 0 and wrapping, to find lost blocks
+	8       496   31 records, unused ones are all zero
+	504     1     number of records used
+	505     5     reserved, 0
+	510     2     Fletcher-16 checksum of bytes 0 - 503
+
+	offset  size  record
+	0       4     micros() at the start of the read
+	4       6     raw X, Y, Z
+	10      2     temperature, INT16_MIN when not read
+	12      1     status register, 0 when not read
+	13      1     flags, QMC5883L_LOG_FAILED when the chip did not answer
+	14      1     control register (mode, data rate, range, over sample ratio)
+	15      1     reserved, 0
+*/
+#define QMC5883L_LOG_BLOCK 512
+#define QMC5883L_LOG_HEADER 8
+#define QMC5883L_LOG_RECORD 16
+#define QMC5883L_LOG_RECORDS 31
+#define QMC5883L_LOG_VERSION 1
+#define QMC5883L_LOG_FAILED 0x01
+
+/**
+	LOG RECORD
+	One record of a log as it is stored, @see QMC5883LLogReader::getRecords().
+**/
+struct QMC5883LLogRecord {
+    uint32_t timestamp;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+    int16_t temperature;
+    uint8_t status;
+    uint8_t flags;
+    uint8_t control;
+    uint8_t reserved;
+};
+
+/**
+	LOG WRITER
+	Records what the compass reads, in the binary log format above, e.g. to an SD card, so a
+	problem seen in the field can be replayed and looked at later, @see QMC5883LLogReplay.
+	Records are passed on as they come, the writer only keeps the checksum of the current block
+	and needs no buffer. Use read() in place of @see QMC5883LCompass::read(), or log the samples
+	from @see QMC5883LCompass::readRaw() with add().
+
+	Example:
+
+	File file;
+
+	size_t writeFile(const uint8_t *data, size_t length, void *context) {
+	  return ((File *)context)->write(data, length);
+	}
+
+	QMC5883LLogWriter log;
+	log.begin(writeFile, &file);
+	log.read(&compass);
+	log.end();
+
+	@since v1.3.0
+**/
+class QMC5883LLogWriter{
+
+public:
+    void begin(size_t (*write)(const uint8_t *data, size_t length, void *context), void *context);
+    bool read(QMC5883LCompass *compass);
+    void add(QMC5883LCompass *compass, const QMC5883LRawSample *raw, bool ok);
+    void end();
+    unsigned long getRecords();
+    unsigned long getErrors();
+
+private:
+    void _write(const uint8_t *data, size_t length);
+    void _endBlock();
+
+    size_t (*_writer)(const uint8_t *data, size_t length, void *context) = nullptr;
+    void *_context = nullptr;
+    unsigned long _records = 0;
+    unsigned long _errors = 0;
+    uint16_t _block = 0;
+    uint16_t _sum1 = 0;
+    uint16_t _sum2 = 0;
+    byte _count = 0;
+};
+
+#ifdef QMC5883L_LINUX
+
+static_assert(sizeof(QMC5883LLogRecord) == QMC5883L_LOG_RECORD, "A log record is 16 bytes");
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The log is read in place, which needs a little endian host");
+
+/**
+	LOG READER
+	Maps a log into memory and gives the records of each block in place, without copying them.
+	Blocks with a bad checksum, e.g. the last one when the power was cut while writing, are
+	skipped.
+
+	Example:
+
+	QMC5883LLogReader log;
+	log.open("compass.log");
+	for ( size_t b = 0; b < log.getBlocks(); b++ ) {
+	  byte count;
+	  const QMC5883LLogRecord *records = log.getRecords(b, &count);
+	  for ( byte i = 0; i < count; i++ ) printf("%d\n", records[i].x);
+	}
+
+	@since v1.3.0
+**/
+class QMC5883LLogReader{
+
+public:
+    ~QMC5883LLogReader();
+    bool open(const char *path);
+    void close();
+    size_t getBlocks();
+    const QMC5883LLogRecord *getRecords(size_t block, byte *count);
+    static bool isLog(const void *data, size_t size);
+
+private:
+    const uint8_t *_data = nullptr;
+    size_t _size = 0;
+};
+
+/**
+	LOG REPLAY
+	Plays a log back through a TwoWire bus as if it was the chip, so the samples go through
+	the whole library again: the bus code, read(), calibration, smoothing and everything that
+	uses them, e.g. to test a change against a recording from the field, or to measure the
+	throughput without a chip. Every read of the data registers returns the next record, failed
+	reads in the log fail again, and the bus stops answering at the end of the log. Writes, such
+	as the settings from init(), are accepted.
+
+	While it runs, micros() and millis() return the recorded time of the next record instead of
+	the time of the replay, so a read gets the timestamp it had in the log and code that runs on
+	a schedule sees the recording's timing. At the end of the log they stay at the last record.
+	delay() still waits in real time, and end() gives back the real clock.
+
+	The bus needs a file it can open, such as /dev/null. One replay runs at a time.
+
+	Example:
+
+	QMC5883LLogReader log;
+	log.open("compass.log");
+
+	TwoWire bus("/dev/null");
+	QMC5883LLogReplay replay;
+	replay.begin(&log, &bus);
+
+	compass.init(&bus);
+	while ( replay.available() ) compass.read();
+
+	@since v1.3.0
+**/
+class QMC5883LLogReplay{
+
+public:
+    ~QMC5883LLogReplay();
+    void begin(QMC5883LLogReader *log, TwoWire *bus);
+    void end();
+    bool available();
+    unsigned long getReplayed();
+
+private:
+    static int _ioctl(int fd, unsigned long request, void *argument);
+    static unsigned long _micros();
+    const QMC5883LLogRecord *_peek();
+
+    QMC5883LLogReader *_log = nullptr;
+    TwoWire *_bus = nullptr;
+    const QMC5883LLogRecord *_records = nullptr;
+    size_t _block = 0;
+    unsigned long _replayed = 0;
+    unsigned long _time = 0;
+    byte _index = 0;
+    byte _count = 0;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef QMC5883L_Manager
+#define QMC5883L_Manager
+
+#include "QMC5883LPlatform.h"
+#include "QMC5883LCompass.h"
+#include "QMC5883LMux.h"
+
+/**
+	SENSOR MANAGER
+	Runs up to N compasses spread over several I2C buses. Every QMC5883L answers at the same
+	address, so each bus holds one sensor, or one per channel of a TCA9548A multiplexer
+	(@see QMC5883LMux). The manager reads them on a fixed schedule and delivers the readings
+	as time aligned sets.
+
+	Each cycle of @see setInterval() microseconds is split into one slot per sensor, so the bus
+	traffic is spread evenly over the cycle instead of arriving in one burst. Sensors on
+	different buses take turns. On each bus the sensors are read in multiplexer and channel
+	order, so every channel is selected once per cycle. Because the reads are staggered, every sensor is read at a
+	slightly different time. When a cycle is complete, each sensor's reading is interpolated
+	to the start of the cycle, using its previous and current sample. A failed read leaves
+	both samples as they were, so the set holds the last good reading of that sensor and
+	@see isValid() is false for it.
+
+	Example:
+
+	QMC5883LManager<4> sensors;
+
+	void setup() {
+	  Wire.begin();
+	  Wire1.begin();
+	  sensors.attach(&Wire);
+	  sensors.attach(&Wire1);
+	  sensors.init();
+	}
+
+	void loop() {
+	  if ( sensors.update() ) {
+	    for ( byte i = 0; i < sensors.getCount(); i++ ) Serial.println(sensors.getX(i));
+	  }
+	}
+
+	@since v1.3.0
+**/
+template <byte N>
+class QMC5883LManager {
+public:
+    QMC5883LManager() {}
+
+    /**
+    	Add a sensor on a bus. Settings such as the address or calibration can be changed through
+    	@see getSensor() after init().
+
+    	@return byte index of the sensor, or 255 when all N places are taken
+    **/
+    byte attach(TwoWire *bus) {
+        return attach(bus, nullptr, 0);
+    }
+
+    /**
+    	Add a sensor on a channel of a multiplexer, which must be initialized on the same bus.
+    	Several multiplexers can share a bus, the others are disabled while one is in use.
+
+    	@return byte index of the sensor, or 255 when all N places are taken
+    **/
+    byte attach(TwoWire *bus, QMC5883LMux *mux, byte channel) {
+        if ( _count >= N ) return 255;
+        _bus[_count] = bus;
+        _mux[_count] = mux;
+        _channel[_count] = channel;
+        return _count++;
+    }
+
+    /**
+    	Initialize all attached sensors and start the schedule. Call it in setup() after attach().
+    **/
+    void init() {
+        for ( byte i = 0; i < _count; i++ ) {
+            _sensors[i].setMultiplexer(_mux[i], _channel[i]);
+            QMC5883LLock lock(_bus[i]);
+            _isolate(i);
+            _sensors[i].init(_bus[i]);
+            for ( byte j = 0; j < 3; j++ ) _current[i][j] = _aligned[i][j] = 0;
+            _currentTime[i] = 0;
+            _errors[i] = 0;
+            _valid[i] = false;
+            _primed[i] = false;
+        }
+        _schedule();
+        _slot = 0;
+        _cycleStart = micros();
+    }
+
+    /**
+    	Length of one read cycle in microseconds, every sensor is read once per cycle. The default
+    	of 5000 matches the 200Hz data rate set by init().
+    **/
+    void setInterval(unsigned long microseconds) {
+        _interval = ( microseconds > 0 ) ? microseconds : 1;
+    }
+
+    /**
+    	Read the sensors whose slot has come. Call it as often as possible from loop().
+
+    	@return bool true when a new time aligned set is ready
+    **/
+    bool update() {
+        unsigned long now = micros();
+        while ( _slot < _count && (long)(now - _slotTime(_slot)) >= 0 ) {
+            byte i = _order[_slot];
+            _slot++;
+
+            // Keep other tasks off the bus between disabling the other multiplexers and the read.
+            QMC5883LLock lock(_bus[i]);
+            _isolate(i);
+            unsigned long readTime = micros();
+            _sensors[i].read();
+            _valid[i] = _sensors[i].getReadErrors() == 0;
+            if ( !_valid[i] ) {
+                _errors[i]++;
+                continue;
+            }
+            for ( byte j = 0; j < 3; j++ ) _previous[i][j] = _current[i][j];
+            _previousTime[i] = _currentTime[i];
+            _currentTime[i] = readTime;
+            _current[i][0] = _sensors[i].getX();
+            _current[i][1] = _sensors[i].getY();
+            _current[i][2] = _sensors[i].getZ();
+        }
+        if ( _slot < _count || _count == 0 ) return false;
+
+        _align(_cycleStart);
+        _setTime = _cycleStart;
+        _cycleStart += _interval;
+        _slot = 0;
+        _cycles++;
+
+        // Start over instead of reading back to back when a whole cycle has been missed.
+        if ( (long)(micros() - _cycleStart) >= (long)_interval ) {
+            _cycleStart = micros();
+            _overruns++;
+        }
+        return true;
+    }
+
+    /**
+    	Direct access to a sensor, for its settings and the latest raw reading.
+    **/
+    QMC5883LCompass &getSensor(byte index) {
+        return _sensors[index];
+    }
+
+    byte getCount() {
+        return _count;
+    }
+
+    /**
+    	Calibrated (and smoothed) axis values of a sensor in the latest set, interpolated to
+    	@see getTimestamp().
+    **/
+    int getX(byte index) {
+        return _aligned[index][0];
+    }
+
+    int getY(byte index) {
+        return _aligned[index][1];
+    }
+
+    int getZ(byte index) {
+        return _aligned[index][2];
+    }
+
+    /**
+    	Whether a sensor was read in the cycle of the latest set. When its read failed, the set
+    	holds its last good reading.
+    **/
+    bool isValid(byte index) {
+        return _valid[index];
+    }
+
+    /**
+    	Number of failed reads of a sensor since init().
+    **/
+    unsigned long getErrors(byte index) {
+        return _errors[index];
+    }
+
+    /**
+    	Time of the latest set, micros() at the start of its cycle.
+    **/
+    unsigned long getTimestamp() {
+        return _setTime;
+    }
+
+    /**
+    	Number of complete sets delivered.
+    **/
+    unsigned long getCycles() {
+        return _cycles;
+    }
+
+    /**
+    	Number of cycles that could not be kept because update() was called too late or the reads
+    	took longer than the interval. Increase the interval or the bus clock if this grows.
+    **/
+    unsigned long getOverruns() {
+        return _overruns;
+    }
+
+private:
+    QMC5883LCompass _sensors[N];
+    TwoWire *_bus[N];
+    QMC5883LMux *_mux[N];
+    unsigned long _previousTime[N];
+    unsigned long _currentTime[N];
+    unsigned long _errors[N];
+    unsigned long _interval = 5000;
+    unsigned long _cycleStart = 0;
+    unsigned long _setTime = 0;
+    unsigned long _cycles = 0;
+    unsigned long _overruns = 0;
+    int16_t _previous[N][3];
+    int16_t _current[N][3];
+    int16_t _aligned[N][3];
+    byte _order[N];
+    byte _channel[N];
+    byte _count = 0;
+    byte _slot = 0;
+    bool _valid[N];
+    bool _primed[N];
+
+    unsigned long _slotTime(byte slot) {
+        return _cycleStart + (unsigned long)(((uint64_t)_interval * slot) / _count);
+    }
+
+    /**
+    	Whether sensor a is read before sensor b on their bus: grouped by multiplexer, then by
+    	channel, so each multiplexer is switched as few times as possible.
+    **/
+    bool _before(byte a, byte b) {
+        if ( _mux[a] != _mux[b] ) return (uintptr_t)_mux[a] < (uintptr_t)_mux[b];
+        return _channel[a] < _channel[b];
+    }
+
+    /**
+    	Read order: take one sensor from each bus in turn, so reads on the same bus are as far
+    	apart as possible, and on each bus go through the sensors in @see _before() order.
+    **/
+    void _schedule() {
+        bool taken[N];
+        for ( byte i = 0; i < _count; i++ ) taken[i] = false;
+
+        byte slot = 0;
+        while ( slot < _count ) {
+            TwoWire *used[N];
+            byte usedCount = 0;
+            for ( byte i = 0; i < _count; i++ ) {
+                if ( taken[i] ) continue;
+                bool busUsed = false;
+                for ( byte j = 0; j < usedCount; j++ ) {
+                    if ( used[j] == _bus[i] ) busUsed = true;
+                }
+                if ( busUsed ) continue;
+
+                byte next = i;
+                for ( byte j = i + 1; j < _count; j++ ) {
+                    if ( !taken[j] && _bus[j] == _bus[i] && _before(j, next) ) next = j;
+                }
+                used[usedCount++] = _bus[i];
+                taken[next] = true;
+                _order[slot++] = next;
+            }
+        }
+    }
+
+    /**
+    	Disable the other multiplexers on the bus of a sensor, so only that sensor answers at its
+    	address. The multiplexers remember their state, so this normally sends nothing.
+    **/
+    void _isolate(byte index) {
+        for ( byte j = 0; j < _count; j++ ) {
+            if ( _bus[j] == _bus[index] && _mux[j] && _mux[j] != _mux[index] ) {
+                _mux[j]->disable();
+            }
+        }
+    }
+
+    /**
+    	Interpolate every sensor between its previous and current sample to the time t, which lies
+    	between the two for all sensors read in the cycle starting at t. Sensors whose read failed
+    	get their current sample, the last good one.
+    **/
+    void _align(unsigned long t) {
+        for ( byte i = 0; i < _count; i++ ) {
+            long span = (long)(_currentTime[i] - _previousTime[i]);
+            long part = span - (long)(_currentTime[i] - t);
+            if ( !_primed[i] || span <= 0 || part < 0 ) {
+                part = span = 1;
+            }
+            if ( part > span ) part = span;
+            for ( byte j = 0; j < 3; j++ ) {
+                long delta = (long)_current[i][j] - _previous[i][j];
+                _aligned[i][j] = (int16_t)(_previous[i][j] + (int64_t)delta * part / span);
+            }
+            if ( _valid[i] ) _primed[i] = true;
+        }
+    }
+};
+
+#endif
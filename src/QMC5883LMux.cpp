@@ -0,0 +1,138 @@
+/*
+===============================================================================================================
+QMC5883LMux.h
+TCA9548A I2C multiplexer support for the QMC5883L Compass library.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+The TCA9548A connects its upstream bus to any of 8 downstream channels, selected by writing a
+bit mask to its single control register. Up to 8 of them (address 0x70 - 0x77) can share a bus.
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LMux.h"
+
+QMC5883LMux::QMC5883LMux() {
+}
+
+/**
+	INIT
+	Use the default Wire bus.
+	
+	@since v1.3.0
+**/
+void QMC5883LMux::init() {
+    init(nullptr);
+}
+
+/**
+	INIT
+	Use the given bus, which must be started with begin() by the sketch or a compass on it.
+	All channels are switched off.
+	
+	@since v1.3.0
+**/
+void QMC5883LMux::init(TwoWire *twi){
+    wire = twi ? twi : &Wire;
+    _known = false;
+    disable();
+}
+
+/**
+	SET ADDRESS
+	Set the I2C address of the multiplexer, 0x70 (the default) - 0x77.
+	
+	@since v1.3.0
+**/
+void QMC5883LMux::setADDR(byte b){
+    _ADDR = b;
+    _known = false;
+}
+
+/**
+	SELECT
+	Connect a channel, and only that channel, to the bus. Nothing is sent when the channel is
+	already selected.
+	
+	@since v1.3.0
+	@param channel 0 - 7
+	@return bool false if the channel does not exist or the multiplexer did not answer
+**/
+bool QMC5883LMux::select(byte channel){
+    if ( channel > 7 ) return false;
+    return _write((byte)(1 << channel));
+}
+
+/**
+	DISABLE
+	Disconnect all channels. Needed before selecting a channel on another multiplexer on the
+	same bus, when both have a compass at the same address.
+	
+	@since v1.3.0
+	@return bool false if the multiplexer did not answer
+**/
+bool QMC5883LMux::disable(){
+    return _write(0);
+}
+
+/**
+	INVALIDATE
+	Forget the selected channel, so the next select() writes it again. Call it when something
+	else may have changed the multiplexer, e.g. another library or a reset.
+	
+	@since v1.3.0
+**/
+void QMC5883LMux::invalidate(){
+    _known = false;
+}
+
+/**
+	GET CHANNEL
+	
+	@since v1.3.0
+	@return byte selected channel 0 - 7, or 255 when no channel or an unknown one is selected
+**/
+byte QMC5883LMux::getChannel(){
+    if ( !_known ) return 255;
+    for ( byte i = 0; i < 8; i++ ) {
+        if ( _mask == (1 << i) ) return i;
+    }
+    return 255;
+}
+
+/**
+	GET SWITCHES
+	Number of times the multiplexer was written, to check how well the reads are ordered.
+	
+	@since v1.3.0
+	@return unsigned long writes since start up
+**/
+unsigned long QMC5883LMux::getSwitches(){
+    return _switches;
+}
+
+/**
+	WRITE
+	Write the channel mask unless it is already set.
+	
+	@since v1.3.0
+**/
+bool QMC5883LMux::_write(byte mask){
+    if ( !wire ) return false;
+    QMC5883LLock lock(wire);
+    if ( _known && _mask == mask ) return true;
+
+    wire->beginTransmission(_ADDR);
+    wire->write(mask);
+    if ( wire->endTransmission() != 0 ) {
+        _known = false;
+        return false;
+    }
+    _mask = mask;
+    _known = true;
+    _switches++;
+    return true;
+}
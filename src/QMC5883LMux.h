@@ -0,0 +1,38 @@
+#ifndef QMC5883L_Mux
+#define QMC5883L_Mux
+
+#include "QMC5883LPlatform.h"
+#include "QMC5883LLock.h"
+
+/**
+	TCA9548A I2C MULTIPLEXER
+	Every QMC5883L answers at the same address, so more than one per bus needs a multiplexer
+	in front of them. The channel that was selected last is remembered, so the multiplexer is
+	only written when a different channel is needed. @see QMC5883LCompass::setMultiplexer().
+	
+	@since v1.3.0
+**/
+class QMC5883LMux{
+
+public:
+    QMC5883LMux();
+    void init();
+    void init(TwoWire *twi);
+    void setADDR(byte b);
+    bool select(byte channel);
+    bool disable();
+    void invalidate();
+    byte getChannel();
+    unsigned long getSwitches();
+
+private:
+    bool _write(byte mask);
+
+    TwoWire *wire = nullptr;
+    unsigned long _switches = 0;
+    byte _ADDR = 0x70;
+    byte _mask = 0;
+    bool _known = false;
+};
+
+#endif
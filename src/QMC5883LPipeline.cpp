@@ -0,0 +1,222 @@
+/*
+===============================================================================================================
+QMC5883LPipeline.h
+Acquisition / processing thread split for the QMC5883L Compass library on Linux.
+Learn more at [https://github.com/mprograms/QMC5883LCompass]
+
+Release under the GNU General Public License v3
+[https://www.gnu.org/licenses/gpl-3.0.en.html]
+
+===============================================================================================================
+*/
+
+#include "QMC5883LPipeline.h"
+
+#ifdef QMC5883L_LINUX
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "The futex must be a plain 32 bit word");
+
+// Sleep until the counter is no longer expected, or 100ms have passed.
+static void QMC5883L_futexWait(std::atomic<uint32_t> *counter, uint32_t expected) {
+    struct timespec timeout = { 0, 100000000L };
+    syscall(SYS_futex, (uint32_t *)counter, FUTEX_WAIT_PRIVATE, expected, &timeout, nullptr, 0);
+}
+
+static void QMC5883L_futexWake(std::atomic<uint32_t> *counter) {
+    syscall(SYS_futex, (uint32_t *)counter, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+QMC5883LPipeline::QMC5883LPipeline()
+    : _running(false),
+      _produced(0),
+      _samples(0),
+      _dropped(0),
+      _overruns(0) {
+}
+
+QMC5883LPipeline::~QMC5883LPipeline() {
+    stop();
+}
+
+/**
+	SET INTERVAL
+	Time between two reads in microseconds. The default of 5000 matches the 200Hz data rate set
+	by init(). 0 reads as fast as the bus allows.
+
+	@since v1.3.0
+**/
+void QMC5883LPipeline::setInterval(unsigned long microseconds) {
+    _interval = microseconds;
+}
+
+/**
+	SET CALLBACK
+	Function called on the processing thread for every sample, after the compass has processed
+	it. The timestamp is the micros() at which its read started.
+
+	@since v1.3.0
+	@param context passed on to the callback
+**/
+void QMC5883LPipeline::setCallback(void (*callback)(QMC5883LCompass *compass, unsigned long timestamp, void *context), void *context) {
+    _callback = callback;
+    _context = context;
+}
+
+/**
+	START
+	Start both threads for a compass that is initialized already. The reading thread gets
+	SCHED_FIFO priority if the system allows it, @see isRealtime().
+
+	@since v1.3.0
+	@return bool false if already running
+**/
+bool QMC5883LPipeline::start(QMC5883LCompass *compass) {
+    if ( _running || !compass ) return false;
+    _compass = compass;
+    _running = true;
+    _processing = std::thread(&QMC5883LPipeline::_process, this);
+    _acquisition = std::thread(&QMC5883LPipeline::_acquire, this);
+    struct sched_param parameter;
+    parameter.sched_priority = QMC5883L_PIPELINE_PRIORITY;
+    _realtime = pthread_setschedparam(_acquisition.native_handle(), SCHED_FIFO, &parameter) == 0;
+    return true;
+}
+
+/**
+	STOP
+	Stop reading, process the samples still in the queue and end both threads.
+
+	@since v1.3.0
+**/
+void QMC5883LPipeline::stop() {
+    if ( !_running ) return;
+    _running = false;
+    if ( _acquisition.joinable() ) _acquisition.join();
+    _produced++;
+    QMC5883L_futexWake(&_produced);
+    if ( _processing.joinable() ) _processing.join();
+}
+
+bool QMC5883LPipeline::isRunning() {
+    return _running;
+}
+
+/**
+	IS REALTIME
+	@since v1.3.0
+	@return bool true if the reading thread runs with SCHED_FIFO priority, false if the system
+	refused it (EPERM without root or CAP_SYS_NICE) and it runs as a normal thread
+**/
+bool QMC5883LPipeline::isRealtime() {
+    return _realtime;
+}
+
+/**
+	GET SAMPLES
+	@since v1.3.0
+	@return unsigned long samples processed, including failed reads
+**/
+unsigned long QMC5883LPipeline::getSamples() {
+    return _samples;
+}
+
+/**
+	GET DROPPED
+	Number of samples thrown away because the queue was full. The processing thread is too slow
+	for the interval when this grows.
+
+	@since v1.3.0
+**/
+unsigned long QMC5883LPipeline::getDropped() {
+    return _dropped;
+}
+
+/**
+	GET OVERRUNS
+	Number of times the reading thread fell a whole interval behind and started over, e.g.
+	because the bus is slower than the interval.
+
+	@since v1.3.0
+**/
+unsigned long QMC5883LPipeline::getOverruns() {
+    return _overruns;
+}
+
+/**
+	ACQUIRE
+	The reading thread: read on an absolute schedule, so the interval does not drift with the
+	time the reads take, and hand every result to the processing thread.
+
+	@since v1.3.0
+**/
+void QMC5883LPipeline::_acquire() {
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while ( _running ) {
+        if ( _interval > 0 ) {
+            while ( clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) == EINTR ) {}
+        }
+
+        Entry entry;
+        entry.ok = _compass->readRaw(&entry.raw);
+        if ( !_queue.push(entry) ) {
+            _dropped++;
+        }
+        _produced++;
+        QMC5883L_futexWake(&_produced);
+
+        if ( _interval == 0 ) continue;
+        next.tv_nsec += (long)(_interval % 1000000) * 1000L;
+        next.tv_sec += (time_t)(_interval / 1000000) + next.tv_nsec / 1000000000L;
+        next.tv_nsec %= 1000000000L;
+
+        // Start over instead of reading back to back when a whole interval has been missed.
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long late = (long long)(now.tv_sec - next.tv_sec) * 1000000000LL + (now.tv_nsec - next.tv_nsec);
+        if ( late >= (long long)_interval * 1000LL ) {
+            next = now;
+            _overruns++;
+        }
+    }
+}
+
+/**
+	PROCESS
+	The processing thread: take the samples from the queue and process them, sleep while it is
+	empty.
+
+	@since v1.3.0
+**/
+void QMC5883LPipeline::_process() {
+    Entry entry;
+    while ( true ) {
+        uint32_t produced = _produced.load();
+        if ( !_queue.pop(&entry) ) {
+            if ( !_running ) break;
+            QMC5883L_futexWait(&_produced, produced);
+            continue;
+        }
+
+        if ( entry.ok ) {
+            _compass->process(&entry.raw);
+        } else {
+            _compass->_readFailed();
+        }
+        _samples++;
+        if ( _callback ) {
+            _callback(_compass, entry.raw.timestamp, _context);
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef QMC5883L_Pipeline
+#define QMC5883L_Pipeline
+
+#include "QMC5883LPlatform.h"
+
+#ifdef QMC5883L_LINUX
+
+#include <atomic>
+#include <thread>
+#include "QMC5883LCompass.h"
+
+// Samples the queue between the two pipeline threads holds, a power of 2.
+#define QMC5883L_PIPELINE_QUEUE 64
+
+// SCHED_FIFO priority of the reading thread, 1 - 99.
+#ifndef QMC5883L_PIPELINE_PRIORITY
+#define QMC5883L_PIPELINE_PRIORITY 10
+#endif
+
+/**
+	SINGLE PRODUCER SINGLE CONSUMER QUEUE
+	A ring buffer for exactly one thread that pushes and one that pops, without locks. Each
+	side only writes its own index, the other side only reads it. SIZE must be a power of 2,
+	one place is kept free to tell a full queue from an empty one.
+
+	@since v1.3.0
+**/
+template <typename T, unsigned int SIZE>
+class QMC5883LQueue {
+    static_assert(SIZE >= 2 && (SIZE & (SIZE - 1)) == 0, "The queue size must be a power of 2");
+
+public:
+    QMC5883LQueue() : _head(0), _tail(0) {}
+
+    /**
+    	Add an item, from the producer thread.
+
+    	@return bool false when the queue is full, the item is not added
+    **/
+    bool push(const T &item) {
+        unsigned int tail = _tail.load(std::memory_order_relaxed);
+        unsigned int next = (tail + 1) & (SIZE - 1);
+        if ( next == _head.load(std::memory_order_acquire) ) return false;
+        _items[tail] = item;
+        _tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /**
+    	Take the oldest item, from the consumer thread.
+
+    	@return bool false when the queue is empty
+    **/
+    bool pop(T *item) {
+        unsigned int head = _head.load(std::memory_order_relaxed);
+        if ( head == _tail.load(std::memory_order_acquire) ) return false;
+        *item = _items[head];
+        _head.store((head + 1) & (SIZE - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    // The indexes are on separate cache lines, so the two threads do not slow each other down.
+    alignas(64) std::atomic<unsigned int> _head;
+    alignas(64) std::atomic<unsigned int> _tail;
+    alignas(64) T _items[SIZE];
+};
+
+/**
+	ACQUISITION / PROCESSING PIPELINE
+	Runs a compass on two threads: one only talks to the bus (@see QMC5883LCompass::readRaw())
+	on a fixed schedule, the other does the calibration, smoothing and whatever the callback
+	does with the sample (@see QMC5883LCompass::process()). A slow callback, e.g. a calibration
+	fit, then no longer delays or skips the next reads. The samples pass through a lock free
+	queue, and the processing thread sleeps until one arrives.
+
+	On a single core the reading thread only gets in while a long calculation runs when it has
+	real time priority. start() asks for SCHED_FIFO (@see QMC5883L_PIPELINE_PRIORITY), which
+	needs root, CAP_SYS_NICE or an rtprio limit. @see isRealtime() tells whether it got it;
+	without it the pipeline still runs, but a slow callback can delay reads as much as on one
+	thread. With several cores the threads run side by side either way.
+
+	The callback runs on the processing thread, where all of the compass functions can be used.
+	Other threads can use @see QMC5883LCompass::getSample(). Change settings before start().
+
+	Example:
+
+	void onSample(QMC5883LCompass *compass, unsigned long timestamp, void *context) {
+	  printf("%d\n", compass->getAzimuth());
+	}
+
+	QMC5883LPipeline pipeline;
+	pipeline.setCallback(onSample, nullptr);
+	pipeline.start(&compass);
+
+	@since v1.3.0
+**/
+class QMC5883LPipeline{
+
+public:
+    QMC5883LPipeline();
+    ~QMC5883LPipeline();
+    void setInterval(unsigned long microseconds);
+    void setCallback(void (*callback)(QMC5883LCompass *compass, unsigned long timestamp, void *context), void *context);
+    bool start(QMC5883LCompass *compass);
+    void stop();
+    bool isRunning();
+    bool isRealtime();
+    unsigned long getSamples();
+    unsigned long getDropped();
+    unsigned long getOverruns();
+
+private:
+    struct Entry {
+        QMC5883LRawSample raw;
+        bool ok;
+    };
+
+    void _acquire();
+    void _process();
+
+    QMC5883LCompass *_compass = nullptr;
+    void (*_callback)(QMC5883LCompass *compass, unsigned long timestamp, void *context) = nullptr;
+    void *_context = nullptr;
+    unsigned long _interval = 5000;
+    std::thread _acquisition;
+    std::thread _processing;
+    std::atomic<bool> _running;
+    bool _realtime = false;
+    std::atomic<uint32_t> _produced;
+    std::atomic<unsigned long> _samples;
+    std::atomic<unsigned long> _dropped;
+    std::atomic<unsigned long> _overruns;
+    QMC5883LQueue<Entry, QMC5883L_PIPELINE_QUEUE> _queue;
+};
+
+#endif
+
+#endif
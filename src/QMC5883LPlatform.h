@@ -0,0 +1,14 @@
+#ifndef QMC5883L_Platform
+#define QMC5883L_Platform
+
+// The library is built for Arduino boards. Built with a regular compiler on Linux (no ARDUINO
+// defined), it talks to the chip through /dev/i2c-N instead, @see QMC5883LLinux.h.
+#if defined(__linux__) && !defined(ARDUINO)
+#define QMC5883L_LINUX
+#include "QMC5883LLinux.h"
+#else
+#include "Arduino.h"
+#include "Wire.h"
+#endif
+
+#endif